@@ -0,0 +1,440 @@
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+
+#include "gol.h"
+
+GameOfLife gol;
+GolBand gol_bands[2];
+uint8_t* row_modified;
+
+static uint32_t gol_lut[1 << 8];
+
+void init_gol(int width, int height, bool in_place) {
+    gol.width_in_words = ((width + 31) / 32);
+    gol.width = gol.width_in_words * 32;
+    gol.height = height;
+    gol.gen_count = 0;
+    gol.full_redraw = 2;
+    gol.in_place = in_place;
+
+    // The compute reads one word beyond the end of each row, so pad by a word.
+    const int board_size = (gol.width / 8) * gol.height + 4;
+    gol.board = (uint32_t*)malloc(board_size);
+    memset(gol.board, 0, board_size);
+    if (in_place) {
+        gol.next_board = nullptr;
+    } else {
+        gol.next_board = (uint32_t*)malloc(board_size);
+        memset(gol.next_board, 0, board_size);
+    }
+
+    row_modified = (uint8_t*)malloc(gol.height);
+    memset(row_modified, 0, gol.height);
+
+    gol_bands[0].miny = 1;
+    gol_bands[0].maxy = gol.height / 2;
+    gol_bands[1].miny = gol.height / 2;
+    gol_bands[1].maxy = gol.height - 1;
+    for (int i = 0; i < 2; ++i) {
+        GolBand& band = gol_bands[i];
+        if (in_place) {
+            const int row_size = gol.width / 8 + 4;
+            uint8_t* rows = (uint8_t*)malloc(row_size * 4);
+            memset(rows, 0, row_size * 4);
+            band.edge_above = (uint32_t*)rows;
+            band.edge_below = (uint32_t*)(rows + row_size);
+            band.saved_rows[0] = (uint32_t*)(rows + row_size * 2);
+            band.saved_rows[1] = (uint32_t*)(rows + row_size * 3);
+        } else {
+            band.edge_above = band.edge_below = nullptr;
+            band.saved_rows[0] = band.saved_rows[1] = nullptr;
+        }
+        band.history.buf = nullptr;
+    }
+
+    uint32_t b = 0;
+    for (int i = 0, j = 0; i < (1 << 12); ++i) {
+        int pop = __builtin_popcount(i & 0x777);
+        if (i & (1 << 5)) {
+            // Alive
+            if (pop == 3 || pop == 4) b |= (1 << j);
+        }
+        else {
+            // Dead
+            if (pop == 3) b |= (1 << j);
+        }
+        pop = __builtin_popcount(i & 0xeee);
+        ++j;
+        if (i & (1 << 6)) {
+            // Alive
+            if (pop == 3 || pop == 4) b |= (1 << j);
+        }
+        else {
+            // Dead
+            if (pop == 3) b |= (1 << j);
+        }
+        if (++j == 32) {
+            gol_lut[i >> 4] = b;
+            j = 0;
+            b = 0;
+        }
+    }
+}
+
+void free_gol() {
+    free(gol.board);
+    free(gol.next_board);
+    free(row_modified);
+    gol.board = gol.next_board = nullptr;
+    row_modified = nullptr;
+    for (int i = 0; i < 2; ++i) {
+        GolBand& band = gol_bands[i];
+        free(band.edge_above);
+        free(band.history.buf);
+        band.edge_above = band.edge_below = nullptr;
+        band.saved_rows[0] = band.saved_rows[1] = nullptr;
+        band.history.buf = nullptr;
+    }
+}
+
+static void history_reset(GolHistory& h) {
+    h.head = h.tail = h.gen_start = 0;
+    h.depth = 0;
+    h.overflow = false;
+}
+
+void gol_init_history(int words_per_band) {
+    for (int i = 0; i < 2; ++i) {
+        GolHistory& h = gol_bands[i].history;
+        free(h.buf);
+        h.buf = words_per_band ? (uint32_t*)malloc(words_per_band * 4) : nullptr;
+        h.mask = words_per_band - 1;
+        history_reset(h);
+    }
+}
+
+void gol_clear_history() {
+    for (int i = 0; i < 2; ++i) history_reset(gol_bands[i].history);
+}
+
+int gol_history_depth() {
+    return std::min(gol_bands[0].history.depth, gol_bands[1].history.depth);
+}
+
+// Append a word to the generation being recorded, dropping the oldest
+// generations to make space.
+static bool history_put(GolHistory& h, uint32_t word) {
+    if (h.overflow) return false;
+    while (h.head - h.tail > h.mask) {
+        if (h.tail == h.gen_start) {
+            h.overflow = true;
+            return false;
+        }
+        h.tail += h.buf[h.tail & h.mask];
+        --h.depth;
+    }
+    h.buf[h.head++ & h.mask] = word;
+    return true;
+}
+
+static void history_begin_generation(GolHistory& h) {
+    if (!h.buf) return;
+    h.gen_start = h.head;
+    history_put(h, 0);
+}
+
+static void history_end_generation(GolHistory& h, const GolStats& stats) {
+    if (!h.buf) return;
+    history_put(h, stats.live);
+    history_put(h, stats.births);
+    history_put(h, stats.deaths);
+    history_put(h, stats.changed_rows);
+    uint32_t len = h.head + 1 - h.gen_start;
+    if (history_put(h, len)) {
+        h.buf[h.gen_start & h.mask] = len;
+        ++h.depth;
+    }
+    else {
+        // Can't step back past a generation we couldn't record
+        history_reset(h);
+    }
+}
+
+static void history_record_row(GolHistory& h, int y, const uint32_t* old_row, const uint32_t* new_row) {
+    if (!h.buf) return;
+    const uint32_t row_header = h.head;
+    if (!history_put(h, y << 16)) return;
+
+    uint32_t runs = 0;
+    uint32_t skip = 0;
+    for (int i = 0; i < gol.width_in_words; ) {
+        if (old_row[i] == new_row[i]) {
+            ++skip;
+            ++i;
+            continue;
+        }
+
+        const uint32_t run_header = h.head;
+        if (!history_put(h, 0)) return;
+        uint32_t len = 0;
+        for (; i < gol.width_in_words && old_row[i] != new_row[i]; ++i, ++len) {
+            if (!history_put(h, old_row[i] ^ new_row[i])) return;
+        }
+        h.buf[run_header & h.mask] = (skip << 16) | len;
+        skip = 0;
+        ++runs;
+    }
+    h.buf[row_header & h.mask] = (y << 16) | runs;
+}
+
+// Undo the newest generation in the band's history, restoring the band's
+// statistics from the generation before it if that is still recorded.
+static void history_step_back(GolBand& band) {
+    GolHistory& h = band.history;
+    const uint32_t len = h.buf[(h.head - 1) & h.mask];
+    const uint32_t end = h.head - 1 - HISTORY_STATS_WORDS;
+    uint32_t p = h.head - len + 1;
+    while (p != end) {
+        const uint32_t row_header = h.buf[p++ & h.mask];
+        const int y = row_header >> 16;
+        uint32_t* row_ptr = &gol.board[y * gol.width_in_words];
+        for (uint32_t runs = row_header & 0xffff; runs > 0; --runs) {
+            const uint32_t run = h.buf[p++ & h.mask];
+            row_ptr += run >> 16;
+            for (uint32_t i = run & 0xffff; i > 0; --i) {
+                *row_ptr++ ^= h.buf[p++ & h.mask];
+            }
+        }
+        row_modified[y] = ROW_CHANGED | ROW_DIRTY;
+    }
+    h.head -= len;
+    --h.depth;
+
+    GolStats& stats = band.stats;
+    if (h.depth == 0) {
+        stats.valid = false;
+        return;
+    }
+    const uint32_t p_stats = h.head - 1 - HISTORY_STATS_WORDS;
+    stats.live = h.buf[p_stats & h.mask];
+    stats.births = h.buf[(p_stats + 1) & h.mask];
+    stats.deaths = h.buf[(p_stats + 2) & h.mask];
+    stats.changed_rows = h.buf[(p_stats + 3) & h.mask];
+    stats.valid = true;
+}
+
+bool gol_step_back() {
+    if (gol_history_depth() == 0) return false;
+
+    for (int i = 0; i < 2; ++i) history_step_back(gol_bands[i]);
+    --gol.gen_count;
+
+    // The back buffers no longer match what the rows were compared against
+    gol.full_redraw = 2;
+    return true;
+}
+
+void setup_from_rle(int w, int h, const char* rle_str, int col_in_words) {
+    memset(gol.board, 0, (gol.width / 8) * gol.height);
+    gol.gen_count = 0;
+    gol.full_redraw = 2;
+    gol_clear_history();
+
+    const char* p = rle_str;
+    const int start_col = col_in_words == 0 ? ((gol.width - w)/2 + 31) / 32 : col_in_words;
+    int x = start_col;
+    int y = (gol.height - h)/2;
+    uint32_t b = 0;
+    int j = 0;
+    while (*p != '!') {
+        int num = 1;
+        if (*p == '\n' || *p == '\r') {
+            p++;
+            continue;
+        }
+        if (*p >= '1' && *p <= '9') {
+            num = *p++ - '0';
+            while (*p >= '0' && *p <= '9') {
+                num *= 10;
+                num += *p++ - '0';
+            }
+        }
+        if (*p == '$') {
+            gol.board[y * gol.width_in_words + x] = b;
+            x = start_col;
+            y += num;
+            p++;
+            j = 0;
+            b = 0;
+        } else {
+            if (*p++ == 'o') {
+                for (int i = 0; i < num; ++i) {
+                    b |= 1 << j;
+                    if (++j == 32) {
+                        gol.board[y * gol.width_in_words + x++] = b;
+                        b = 0;
+                        j = 0;
+                    }
+                }
+            }
+            else {
+                j += num;
+                while (j >= 32) {
+                    gol.board[y * gol.width_in_words + x++] = b;
+                    b = 0;
+                    j -= 32;
+                }
+            }
+        }
+    }
+    gol.board[y * gol.width_in_words + x] = b;
+}
+
+// Add the live cells, births and deaths in one word of the new generation to stats
+static inline void gol_count_word(uint32_t old, uint32_t nb, GolStats* stats) {
+    if (old | nb) {
+        stats->live += __builtin_popcount(nb);
+        stats->births += __builtin_popcount(nb & ~old);
+        stats->deaths += __builtin_popcount(old & ~nb);
+    }
+}
+
+// Compute the next generation of one row into out, from the current generation
+// of the rows above, on and below it.
+// Returns ROW_CHANGED if the new row differs from row, and ROW_DIRTY if it differs
+// from the previous contents of out.
+// Live cells, births and deaths are added to stats as each word is stored.
+static uint8_t gol_compute_row(const uint32_t* above, const uint32_t* row, const uint32_t* below, uint32_t* out, GolStats* stats) {
+    uint8_t modified = 0;
+    const uint32_t* old = row;
+    uint32_t b_above = above[0];
+    uint32_t b_this = row[0];
+    uint32_t b_below = below[0];
+    int i = 1;
+    uint32_t nb = 0;
+    for (int x = 1, j = 1; x < gol.width - 1; x += 2) {
+        uint32_t lookup = ((b_above & 0xf) << 8) | ((b_this & 0xf) << 4) | (b_below & 0xf);
+        uint32_t bit = (gol_lut[lookup >> 4] >> ((2 * lookup) & 0x1e)) & 3;
+        nb |= bit << j;
+        b_above >>= 2;
+        b_this >>= 2;
+        b_below >>= 2;
+        j += 2;
+        if (j == 33) {
+            j = 1;
+            gol_count_word(*old, nb, stats);
+            if (*old++ != nb) modified |= ROW_CHANGED;
+            if (*out != nb) modified |= ROW_DIRTY;
+            *out++ = nb;
+            nb = bit >> 1;
+        }
+        if (j == 17) {
+            b_above |= above[i] << 16;
+            b_this |= row[i] << 16;
+            b_below |= below[i] << 16;
+
+            if (b_above == 0 && b_this == 0 && b_below == 0) {
+                x += 16;
+                if (x < gol.width - 1) {
+                    j = 1;
+                    gol_count_word(*old, nb, stats);
+                    if (*old++ != nb) modified |= ROW_CHANGED;
+                    if (*out != nb) modified |= ROW_DIRTY;
+                    *out++ = nb;
+                    nb = 0;
+                }
+            }
+        }
+        if (j == 1) {
+            b_above |= above[i] & 0xFFFF0000;
+            b_this |= row[i] & 0xFFFF0000;
+            b_below |= below[i] & 0xFFFF0000;
+            ++i;
+            if (b_above == 0 && b_this == 0 && b_below == 0) {
+                x += 14;
+                j = 15;
+            }
+        }
+    }
+    gol_count_word(*old, nb, stats);
+    if (*old != nb) modified |= ROW_CHANGED;
+    if (*out != nb) modified |= ROW_DIRTY;
+    *out = nb;
+    return modified;
+}
+
+void gol_compute(GolBand* band) {
+    const int w = gol.width_in_words;
+    uint32_t* row_ptr = &gol.board[w * band->miny];
+
+    GolStats* stats = &band->stats;
+    memset(stats, 0, sizeof(GolStats));
+    stats->valid = true;
+    history_begin_generation(band->history);
+
+    if (!gol.in_place) {
+        uint32_t* next_row_ptr = &gol.next_board[w * band->miny];
+        for (int y = band->miny; y < band->maxy; ++y) {
+            row_modified[y] = gol_compute_row(row_ptr - w, row_ptr, row_ptr + w, next_row_ptr, stats);
+            if (row_modified[y] & ROW_CHANGED) {
+                ++stats->changed_rows;
+                history_record_row(band->history, y, row_ptr, next_row_ptr);
+            }
+            row_ptr += w;
+            next_row_ptr += w;
+        }
+        history_end_generation(band->history, *stats);
+        return;
+    }
+
+    // Each row is saved before it is overwritten, so the row below can still
+    // be computed from it.  The last row in the band uses the saved edge instead
+    // of the row below, which the other core may already have updated.
+    const uint32_t* above = band->edge_above;
+    for (int y = band->miny; y < band->maxy; ++y) {
+        uint32_t* saved = band->saved_rows[y & 1];
+        memcpy(saved, row_ptr, w * 4);
+        const uint32_t* below = (y + 1 == band->maxy) ? band->edge_below : row_ptr + w;
+        uint8_t modified = gol_compute_row(above, saved, below, row_ptr, stats);
+        if (modified & ROW_CHANGED) {
+            ++stats->changed_rows;
+            history_record_row(band->history, y, saved, row_ptr);
+        }
+        if (row_modified[y] & ROW_CHANGED) modified |= ROW_DIRTY;
+        row_modified[y] = modified;
+        above = saved;
+        row_ptr += w;
+    }
+    history_end_generation(band->history, *stats);
+}
+
+// In place mode: take copies of the rows bordering each band before either core
+// starts updating the board.
+static void gol_save_band_edges() {
+    const int row_size = gol.width / 8;
+    for (int i = 0; i < 2; ++i) {
+        GolBand& band = gol_bands[i];
+        memcpy(band.edge_above, &gol.board[gol.width_in_words * (band.miny - 1)], row_size);
+        memcpy(band.edge_below, &gol.board[gol.width_in_words * band.maxy], row_size);
+    }
+}
+
+void gol_begin_generation() {
+    if (gol.in_place) gol_save_band_edges();
+}
+
+void gol_end_generation() {
+    if (!gol.in_place) std::swap(gol.board, gol.next_board);
+    ++gol.gen_count;
+}
+
+GolStats gol_stats() {
+    GolStats total = gol_bands[0].stats;
+    total.live += gol_bands[1].stats.live;
+    total.births += gol_bands[1].stats.births;
+    total.deaths += gol_bands[1].stats.deaths;
+    total.changed_rows += gol_bands[1].stats.changed_rows;
+    total.valid &= gol_bands[1].stats.valid;
+    return total;
+}
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <stdint.h>
+
+struct GameOfLife {
+    int width; // Must be multiple of 32
+    int width_in_words;
+    int height;
+    int gen_count;
+    int full_redraw; // Number of frames still to be drawn in full
+    bool in_place; // Update board in place, next_board is not allocated
+    uint32_t* board;
+    uint32_t* next_board;
+};
+
+// Each band keeps its own history, a ring buffer of XOR deltas between
+// generations.  Each generation is a word giving its length, the changed rows,
+// its GolStats as HISTORY_STATS_WORDS words, and the length again so the newest
+// generation can be found from the end.
+// A changed row is a word with the row number in the top half and number of
+// runs in the bottom half.  Each run of changed words is a word with the number
+// of unchanged words skipped in the top half and the run length in the bottom
+// half, followed by the XOR of the old and new words.
+struct GolHistory {
+    uint32_t* buf;       // nullptr if history is disabled
+    uint32_t mask;       // Size of buf in words minus one, must be a power of 2
+    uint32_t head;       // Next word to write
+    uint32_t tail;       // Start of the oldest generation
+    uint32_t gen_start;  // Start of the generation being recorded
+    int depth;           // Number of complete generations
+    bool overflow;       // The generation being recorded doesn't fit
+};
+
+// Activity in the last generation, gathered while computing it
+struct GolStats {
+    int live;
+    int births;
+    int deaths;
+    int changed_rows;
+    bool valid; // False after stepping back to a generation whose statistics weren't kept
+};
+
+#define HISTORY_STATS_WORDS 4 // live, births, deaths and changed_rows
+
+// Each core computes one horizontal band of the board.
+// In place mode needs copies of the rows bordering the band, taken before either
+// core starts writing, plus two rolling copies of the original rows within the band.
+struct GolBand {
+    int miny, maxy;
+    uint32_t* edge_above;
+    uint32_t* edge_below;
+    uint32_t* saved_rows[2];
+    GolHistory history;
+    GolStats stats;
+};
+
+#define ROW_CHANGED 1 // Row changed in the last generation
+#define ROW_DIRTY   2 // Row differs from the back buffer, two generations ago
+
+extern GameOfLife gol;
+extern GolBand gol_bands[2];
+
+// ROW_CHANGED and ROW_DIRTY flags for each row
+extern uint8_t* row_modified;
+
+// Allocate a board of at least width x height, rounding the width up to a multiple of 32.
+// The edge cells of the board are never alive.
+void init_gol(int width, int height, bool in_place = false);
+void free_gol();
+
+// Clear the board and place the RLE pattern of size w x h in the centre, or with its
+// left edge at the given word column.
+void setup_from_rle(int w, int h, const char* rle_str, int col_in_words = 0);
+
+// Keep up to words_per_band words of history for each band, 0 to disable.
+// words_per_band must be a power of 2.
+void gol_init_history(int words_per_band);
+void gol_clear_history();
+
+// Number of generations that can be stepped back
+int gol_history_depth();
+
+// Go back one generation, returns false if there is no history left
+bool gol_step_back();
+
+// To compute a generation call gol_begin_generation, then gol_compute for both bands,
+// which may run concurrently, then gol_end_generation.
+void gol_begin_generation();
+void gol_compute(GolBand* band);
+void gol_end_generation();
+
+// Statistics for the last generation over both bands
+GolStats gol_stats();
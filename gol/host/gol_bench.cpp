@@ -0,0 +1,256 @@
+// Run Game of Life patterns on the host through the same kernel as the PicoVision,
+// reporting speed, final population and a hash of the board.
+//
+//   gol_bench [--in-place] pattern.rle width height generations
+//   gol_bench --corpus corpus.txt
+//
+// The corpus runs every pattern listed in both update modes and fails if any
+// population or hash doesn't match.  It also records the history for the first
+// generations of each pattern and checks that stepping back restores the board
+// and statistics, once with room for every generation and once with a history
+// small enough to drop old generations or overflow.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include "gol.h"
+
+#define HISTORY_CHECK_GENERATIONS 100
+#define FULL_HISTORY_WORDS (1 << 22)
+#define SMALL_HISTORY_WORDS 256
+
+struct RunResult {
+    double seconds;
+    int population;
+    uint64_t hash;
+    GolStats stats;
+};
+
+// Load an RLE file, returning the pattern with the newlines removed
+static bool load_rle(const char* filename, int& w, int& h, std::string& rle) {
+    FILE* f = fopen(filename, "r");
+    if (!f) {
+        fprintf(stderr, "Can't open %s\n", filename);
+        return false;
+    }
+
+    bool have_header = false;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        if (line[0] == '#') continue;
+        if (!have_header) {
+            if (sscanf(line, " x = %d , y = %d", &w, &h) != 2) break;
+            have_header = true;
+            continue;
+        }
+        for (char* p = line; *p; ++p) {
+            if (*p > ' ') rle += *p;
+        }
+    }
+    fclose(f);
+
+    if (!have_header || rle.find('!') == std::string::npos) {
+        fprintf(stderr, "%s is not a valid RLE file\n", filename);
+        return false;
+    }
+    return true;
+}
+
+static int board_population() {
+    int population = 0;
+    for (int i = 0; i < gol.width_in_words * gol.height; ++i) {
+        population += __builtin_popcount(gol.board[i]);
+    }
+    return population;
+}
+
+// 64-bit FNV-1a of the board words, little endian
+static uint64_t board_hash() {
+    uint64_t hash = 14695981039346656037ull;
+    for (int i = 0; i < gol.width_in_words * gol.height; ++i) {
+        for (int b = 0; b < 32; b += 8) {
+            hash ^= (gol.board[i] >> b) & 0xff;
+            hash *= 1099511628211ull;
+        }
+    }
+    return hash;
+}
+
+static bool run_pattern(const char* filename, int width, int height, int generations, bool in_place, RunResult& result) {
+    int w, h;
+    std::string rle;
+    if (!load_rle(filename, w, h, rle)) return false;
+    if (w > width - 2 || h > height - 2) {
+        fprintf(stderr, "%s doesn't fit on a %dx%d board\n", filename, width, height);
+        return false;
+    }
+
+    init_gol(width, height, in_place);
+    setup_from_rle(w, h, rle.c_str());
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < generations; ++i) {
+        gol_begin_generation();
+        gol_compute(&gol_bands[0]);
+        gol_compute(&gol_bands[1]);
+        gol_end_generation();
+    }
+    result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    result.population = board_population();
+    result.hash = board_hash();
+    result.stats = gol_stats();
+
+    free_gol();
+    return true;
+}
+
+static bool same_stats(const GolStats& a, const GolStats& b) {
+    return a.live == b.live && a.births == b.births && a.deaths == b.deaths && a.changed_rows == b.changed_rows;
+}
+
+// Run some generations with history_words of history per band, then step back as
+// far as the history allows, checking each generation against the board hash and
+// statistics saved on the way forward.  Returns the number of generations stepped
+// back, or -1 on failure.
+static int check_history(const char* filename, int width, int height, int generations, bool in_place, int history_words) {
+    int w, h;
+    std::string rle;
+    if (!load_rle(filename, w, h, rle)) return -1;
+
+    init_gol(width, height, in_place);
+    gol_init_history(history_words);
+    setup_from_rle(w, h, rle.c_str());
+
+    std::vector<uint64_t> hashes(generations + 1);
+    std::vector<GolStats> stats(generations + 1);
+    hashes[0] = board_hash();
+    for (int i = 1; i <= generations; ++i) {
+        gol_begin_generation();
+        gol_compute(&gol_bands[0]);
+        gol_compute(&gol_bands[1]);
+        gol_end_generation();
+        hashes[i] = board_hash();
+        stats[i] = gol_stats();
+    }
+
+    int steps = 0;
+    bool ok = gol_history_depth() <= generations;
+    while (ok && gol_step_back()) {
+        const int gen = generations - ++steps;
+        const GolStats restored = gol_stats();
+        if (gen < 0 || board_hash() != hashes[gen]) ok = false;
+        else if (restored.valid) ok = gen > 0 && same_stats(restored, stats[gen]);
+        else ok = gol_history_depth() == 0;
+    }
+
+    free_gol();
+    return ok ? steps : -1;
+}
+
+static void print_result(const char* name, int width, int height, int generations, bool in_place, const RunResult& result) {
+    double gens_per_sec = generations / result.seconds;
+    printf("%-20s %5dx%-5d %6d gens %-8s %10.1f gen/s %9.1f Mcell/s  population %6d  hash %016llx",
+           name, width, height, generations, in_place ? "in-place" : "two-buf",
+           gens_per_sec, gens_per_sec * width * height * 1e-6,
+           result.population, (unsigned long long)result.hash);
+}
+
+static int run_corpus(const char* corpus_filename) {
+    FILE* f = fopen(corpus_filename, "r");
+    if (!f) {
+        fprintf(stderr, "Can't open %s\n", corpus_filename);
+        return 1;
+    }
+
+    std::string dir = corpus_filename;
+    size_t slash = dir.find_last_of('/');
+    dir = (slash == std::string::npos) ? "" : dir.substr(0, slash + 1);
+
+    int num_failed = 0;
+    int num_run = 0;
+    char line[1024];
+    while (fgets(line, sizeof(line), f)) {
+        char name[256];
+        int width, height, generations, population;
+        unsigned long long hash;
+        if (line[0] == '#') continue;
+        if (sscanf(line, "%255s %d %d %d %d %llx", name, &width, &height, &generations, &population, &hash) != 6) continue;
+
+        for (int in_place = 0; in_place < 2; ++in_place) {
+            RunResult result;
+            std::string path = dir + name;
+            ++num_run;
+            if (!run_pattern(path.c_str(), width, height, generations, in_place, result)) {
+                ++num_failed;
+                continue;
+            }
+
+            print_result(name, width, height, generations, in_place, result);
+            if (result.population != population || result.hash != hash) {
+                printf("  FAIL, expected population %d hash %016llx\n", population, hash);
+                ++num_failed;
+            }
+            else if (generations > 0 && result.stats.live != population) {
+                printf("  FAIL, compute counted %d alive\n", result.stats.live);
+                ++num_failed;
+            }
+            else {
+                printf("  ok\n");
+            }
+
+            // With room for every generation stepping back must reach the start,
+            // the small history only has to restore the generations it kept.
+            const int history_gens = std::min(generations, HISTORY_CHECK_GENERATIONS);
+            const int full_steps = check_history(path.c_str(), width, height, history_gens, in_place, FULL_HISTORY_WORDS);
+            const int small_steps = check_history(path.c_str(), width, height, history_gens, in_place, SMALL_HISTORY_WORDS);
+            printf("%-20s stepped back %d of %d generations, %d with a %d word history",
+                   name, full_steps, history_gens, small_steps, SMALL_HISTORY_WORDS);
+            if (full_steps != history_gens || small_steps < 0) {
+                printf("  FAIL\n");
+                ++num_failed;
+            }
+            else {
+                printf("  ok\n");
+            }
+        }
+    }
+    fclose(f);
+
+    printf("%d of %d runs passed\n", num_run - num_failed, num_run);
+    return num_failed ? 1 : 0;
+}
+
+int main(int argc, char** argv) {
+    if (argc == 3 && strcmp(argv[1], "--corpus") == 0) {
+        return run_corpus(argv[2]);
+    }
+
+    bool in_place = false;
+    int arg = 1;
+    if (argc > 1 && strcmp(argv[1], "--in-place") == 0) {
+        in_place = true;
+        ++arg;
+    }
+    if (argc - arg != 4) {
+        fprintf(stderr, "Usage: %s [--in-place] pattern.rle width height generations\n"
+                        "       %s --corpus corpus.txt\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    const char* filename = argv[arg];
+    int width = atoi(argv[arg + 1]);
+    int height = atoi(argv[arg + 2]);
+    int generations = atoi(argv[arg + 3]);
+
+    RunResult result;
+    if (!run_pattern(filename, width, height, generations, in_place, result)) return 1;
+    print_result(filename, width, height, generations, in_place, result);
+    printf("\n%d alive, %d births, %d deaths, %d rows changed in the last generation\n",
+           result.stats.live, result.stats.births, result.stats.deaths, result.stats.changed_rows);
+    return 0;
+}
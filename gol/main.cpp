@@ -6,6 +6,8 @@
 
 #include "hardware/structs/rosc.h"
 
+#include "gol.h"
+
 bool get_random_bit() {
     return rosc_hw->randombit;
 }
@@ -23,6 +25,15 @@ using namespace pimoroni;
 #define FRAME_WIDTH 640
 #define FRAME_HEIGHT 480
 
+// The board must be at least as big as the frame.  If it is bigger it is shown zoomed
+// out so it fits.  In place mode allows a board twice the size in the same memory.
+#define GOL_WIDTH FRAME_WIDTH
+#define GOL_HEIGHT FRAME_HEIGHT
+#define GOL_IN_PLACE 0
+
+// Words of history kept by each core for stepping back, must be a power of 2
+#define GOL_HISTORY_WORDS 8192
+
 static DVDisplay display;
 static PicoGraphics_PenDV_P5 graphics(FRAME_WIDTH, FRAME_HEIGHT, display);
 
@@ -33,60 +44,20 @@ void on_uart_rx() {
     }
 }
 
+// Pens 2 to 17 shade blocks of cells by how many are alive when zoomed out
+#define DENSITY_PEN 2
+#define DENSITY_LEVELS 16
+
 static void init_palette() {
     graphics.create_pen(0, 0, 0);
     graphics.create_pen(255, 255, 255);
-}
-
-struct GameOfLife {
-    int width; // Must be multiple of 32
-    int width_in_words;
-    int height;
-    int gen_count;
-    uint32_t* board;
-    uint32_t* next_board;
-} gol;
-
-uint32_t gol_lut[1 << 8];
-
-void init_gol(int width, int height) {
-    gol.width_in_words = ((width + 31) / 32);
-    gol.width = gol.width_in_words * 32;
-    gol.height = height;
-    gol.gen_count = 0;
-    gol.board = (uint32_t*)malloc((gol.width / 8) * gol.height);
-    memset(gol.board, 0, (gol.width / 8) * gol.height);
-    gol.next_board = (uint32_t*)malloc((gol.width / 8) * gol.height);
-    memset(gol.next_board, 0, (gol.width / 8) * gol.height);
-
-    uint32_t b = 0;
-    for (int i = 0, j = 0; i < (1 << 12); ++i) {
-        int pop = __builtin_popcount(i & 0x777);
-        if (i & (1 << 5)) {
-            // Alive
-            if (pop == 3 || pop == 4) b |= (1 << j);
-        }
-        else {
-            // Dead
-            if (pop == 3) b |= (1 << j);
-        }
-        pop = __builtin_popcount(i & 0xeee);
-        ++j;
-        if (i & (1 << 6)) {
-            // Alive
-            if (pop == 3 || pop == 4) b |= (1 << j);
-        }
-        else {
-            // Dead
-            if (pop == 3) b |= (1 << j);
-        }
-        if (++j == 32) {
-            gol_lut[i >> 4] = b;
-            j = 0;
-            b = 0;
-        }
+    for (int i = 1; i <= DENSITY_LEVELS; ++i) {
+        uint8_t v = i * 255 / DENSITY_LEVELS;
+        graphics.create_pen(v >> 1, v, v >> 1);
     }
+}
 
+static void init_random_board() {
     // Initial state
     #if 1
     gol.board[gol.width_in_words] = 0x30;
@@ -109,134 +80,106 @@ void init_gol(int width, int height) {
     #endif
 }
 
-void setup_from_rle(int w, int h, const char* rle_str, int col_in_words = 0) {
-    memset(gol.board, 0, (gol.width / 8) * gol.height);
-    gol.gen_count = 0;
-
-    const char* p = rle_str;
-    const int start_col = col_in_words == 0 ? ((gol.width - w)/2 + 31) / 32 : col_in_words;
-    int x = start_col;
-    int y = (gol.height - h)/2;
-    uint32_t b = 0;
-    int j = 0;
-    while (*p != '!') {
-        int num = 1;
-        if (*p == '\n' || *p == '\r') {
-            p++;
-            continue;
-        }
-        if (*p >= '1' && *p <= '9') {
-            num = *p++ - '0';
-            while (*p >= '0' && *p <= '9') {
-                num *= 10;
-                num += *p++ - '0';
-            }
-        }
-        if (*p == '$') {
-            gol.board[y * gol.width_in_words + x] = b;
-            x = start_col;
-            y += num;
-            p++;
-            j = 0;
-            b = 0;
-        } else {
-            if (*p++ == 'o') {
-                for (int i = 0; i < num; ++i) {
-                    b |= 1 << j;
-                    if (++j == 32) {
-                        gol.board[y * gol.width_in_words + x++] = b;
-                        b = 0;
-                        j = 0;
-                    }
-                }
-            }
-            else {
-                j += num;
-                while (j >= 32) {
-                    gol.board[y * gol.width_in_words + x++] = b;
-                    b = 0;
-                    j -= 32;
-                }
-            }
-        }
+void gol_generation() {
+    gol_begin_generation();
+
+    multicore_fifo_push_blocking(0);
+    gol_compute(&gol_bands[0]);
+    multicore_fifo_pop_blocking();
+
+    gol_end_generation();
+}
+
+static void display_row(int y, uint8_t* buf) {
+    display.write_palette_pixel_span({0, y}, FRAME_WIDTH, buf);
+}
+
+// Each display pixel shows a display_zoom x display_zoom block of cells
+static int display_zoom = 1;
+
+// Pixel value for each count of live cells in a block
+static uint8_t density_lut[8 * 8 + 1];
+
+void init_display_zoom() {
+    display_zoom = 1;
+    while (display_zoom < 8 &&
+           (gol.width > FRAME_WIDTH * display_zoom || gol.height > FRAME_HEIGHT * display_zoom)) {
+        display_zoom <<= 1;
+    }
+
+    const int cells = display_zoom * display_zoom;
+    density_lut[0] = 0;
+    for (int i = 1; i <= cells; ++i) {
+        int level = (i * DENSITY_LEVELS + cells - 1) / cells;
+        density_lut[i] = (DENSITY_PEN + level - 1) << 2;
     }
-    gol.board[y * gol.width_in_words + x] = b;
 }
 
-static uint8_t row_modified[FRAME_HEIGHT];
-
-void gol_compute(int miny, int maxy) {
-    uint32_t* board_ptr = &gol.board[gol.width_in_words * (miny - 1)];
-    uint32_t* next_board_ptr = &gol.next_board[gol.width_in_words * miny];
-    for (int y = miny; y < maxy; ++y) {
-        row_modified[y] = 0;
-        uint32_t b_above = board_ptr[0];
-        uint32_t b_this = board_ptr[gol.width_in_words];
-        uint32_t b_below = board_ptr[2 * gol.width_in_words];
-        ++board_ptr;
-        uint32_t nb = 0;
-        for (int x = 1, j = 1; x < gol.width - 1; x += 2) {
-            uint32_t lookup = ((b_above & 0xf) << 8) | ((b_this & 0xf) << 4) | (b_below & 0xf);
-            uint32_t bit = (gol_lut[lookup >> 4] >> ((2 * lookup) & 0x1e)) & 3;
-            nb |= bit << j;
-            b_above >>= 2;
-            b_this >>= 2;
-            b_below >>= 2;
-            j += 2;
-            if (j == 33) {
-                j = 1;
-                if (*next_board_ptr != nb) row_modified[y] = 1;
-                *next_board_ptr++ = nb;
-                nb = bit >> 1;
-            }
-            if (j == 17) {
-                b_above |= board_ptr[0] << 16;
-                b_this |= board_ptr[gol.width_in_words] << 16;
-                b_below |= board_ptr[gol.width_in_words * 2] << 16;
-
-                if (b_above == 0 && b_this == 0 && b_below == 0) {
-                    x += 16;
-                    if (x < gol.width - 1) {
-                        j = 1;
-                        if (*next_board_ptr != nb) row_modified[y] = 1;
-                        *next_board_ptr++ = nb;
-                        nb = 0;
-                    }
-                }
-            }
-            if (j == 1) {
-                b_above |= board_ptr[0] & 0xFFFF0000;
-                b_this |= board_ptr[gol.width_in_words] & 0xFFFF0000;
-                b_below |= board_ptr[gol.width_in_words * 2] & 0xFFFF0000;
-                ++board_ptr;
-                if (b_above == 0 && b_this == 0 && b_below == 0) {
-                    x += 14;
-                    j = 15;
-                }
+// Shade one display row from ZOOM board rows, without unpacking the cells.
+// Each board word is reduced to per block live counts by the usual SWAR popcount steps,
+// stopping once each count field is ZOOM bits wide.  The counts are spread across
+// byte lanes so they can be summed over the rows without overflowing.
+template<int ZOOM>
+static void display_gol_zoomed_row(const uint32_t* board_ptr, int num_rows, int num_words, uint8_t* buf) {
+    constexpr int LANES = 8 / ZOOM;
+    constexpr uint32_t LANE_MASK = 0x01010101u * ((1u << ZOOM) - 1);
+
+    for (int w = 0; w < num_words; ++w) {
+        uint32_t acc[LANES] = {};
+        const uint32_t* ptr = board_ptr + w;
+        for (int r = 0; r < num_rows; ++r, ptr += gol.width_in_words) {
+            uint32_t c = *ptr;
+            if (c == 0) continue;
+            c -= (c >> 1) & 0x55555555;
+            if (ZOOM >= 4) c = (c & 0x33333333) + ((c >> 2) & 0x33333333);
+            if (ZOOM == 8) c = (c + (c >> 4)) & 0x0f0f0f0f;
+            for (int l = 0; l < LANES; ++l) {
+                acc[l] += (c >> (ZOOM * l)) & LANE_MASK;
             }
         }
-        if (*next_board_ptr != nb) row_modified[y] = 1;
-        *next_board_ptr++ = nb;
+
+        // Block m of the word is in lane m % LANES, byte m / LANES
+        for (int m = 0; m < 32 / ZOOM; ++m) {
+            *buf++ = density_lut[(acc[m % LANES] >> (8 * (m / LANES))) & 0xff];
+        }
     }
 }
 
-void gol_generation() {
-    multicore_fifo_push_blocking(0);
-    gol_compute(1, gol.height / 2);
-    multicore_fifo_pop_blocking();
+static uint8_t row_buf[FRAME_WIDTH] alignas(4);
 
-    std::swap(gol.board, gol.next_board);
-    ++gol.gen_count;
-}
+static void display_gol_zoomed() {
+    const int num_words = std::min(gol.width_in_words, FRAME_WIDTH * display_zoom / 32);
+    const int board_pixels = num_words * 32 / display_zoom;
+    memset(row_buf + board_pixels, 0, FRAME_WIDTH - board_pixels);
 
-static void display_row(int y, uint8_t* buf) {
-    display.write_palette_pixel_span({0, y}, FRAME_WIDTH, buf);
+    for (int y = 0; y < FRAME_HEIGHT; ++y) {
+        const int miny = y * display_zoom;
+        const int num_rows = std::min(display_zoom, gol.height - miny);
+
+        bool modified = gol.full_redraw > 0;
+        for (int i = 0; i < num_rows && !modified; ++i) {
+            if (row_modified[miny + i] & ROW_DIRTY) modified = true;
+        }
+        if (!modified) continue;
+
+        if (num_rows <= 0) {
+            memset(row_buf, 0, board_pixels);
+        } else {
+            const uint32_t* board_ptr = &gol.board[miny * gol.width_in_words];
+            switch (display_zoom) {
+                case 2: display_gol_zoomed_row<2>(board_ptr, num_rows, num_words, row_buf); break;
+                case 4: display_gol_zoomed_row<4>(board_ptr, num_rows, num_words, row_buf); break;
+                default: display_gol_zoomed_row<8>(board_ptr, num_rows, num_words, row_buf); break;
+            }
+        }
+
+        display_row(y, row_buf);
+    }
 }
 
-static uint8_t row_buf[FRAME_WIDTH] alignas(4);
-void display_gol() {
+static void display_gol_unzoomed() {
     for (int y = 0; y < FRAME_HEIGHT; ++y) {
-        if (gol.gen_count < 2 || row_modified[y]) {
+        if (gol.full_redraw > 0 || (row_modified[y] & ROW_DIRTY)) {
             uint32_t* board_ptr = &gol.board[y * gol.width_in_words];
             for (int x = 0, j = 0; x < FRAME_WIDTH; ++x) {
                 row_buf[x] = (*board_ptr & (1 << j)) ? 4 : 0;
@@ -251,10 +194,21 @@ void display_gol() {
     }
 }
 
+void display_gol() {
+    if (display_zoom > 1) {
+        display_gol_zoomed();
+    }
+    else {
+        display_gol_unzoomed();
+    }
+
+    if (gol.full_redraw > 0) --gol.full_redraw;
+}
+
 void core1_main() {
     while (true) {
         multicore_fifo_pop_blocking();
-        gol_compute(gol.height / 2, gol.height - 1);
+        gol_compute(&gol_bands[1]);
         multicore_fifo_push_blocking(0);
     }
 }
@@ -401,7 +355,10 @@ int main() {
   display.init(FRAME_WIDTH, FRAME_HEIGHT, DVDisplay::MODE_PALETTE, FRAME_WIDTH, FRAME_HEIGHT);
 
     init_palette();
-    init_gol(FRAME_WIDTH, FRAME_HEIGHT);
+    init_gol(GOL_WIDTH, GOL_HEIGHT, GOL_IN_PLACE);
+    init_random_board();
+    init_display_zoom();
+    gol_init_history(GOL_HISTORY_WORDS);
     //setup_from_rle(95, 73, reburn_rle, 15);
     //setup_from_rle(334, 103, back_and_forth_rle);
     setup_from_rle(155, 175, quetzal);
@@ -415,12 +372,33 @@ int main() {
     while(true) {
         //sleep_ms(500);
         absolute_time_t start_time = get_absolute_time();
-        gol_generation();
+        if (display.is_button_a_pressed()) {
+            // Step back while A is held, or wait if there is no more history
+            if (!gol_step_back()) {
+                sleep_ms(10);
+                continue;
+            }
+        }
+        else if (display.is_button_x_pressed()) {
+            // Paused
+            sleep_ms(10);
+            continue;
+        }
+        else {
+            gol_generation();
+        }
         absolute_time_t mid_time = get_absolute_time();
         //printf("Computing gen %d took %.2fms\n", gol.gen_count, absolute_time_diff_us(start_time, mid_time) * 0.001f);
         display.wait_for_flip();
         display_gol();
-        printf("Gen %d Compute %.2fms, draw %.2fms\n", gol.gen_count, absolute_time_diff_us(start_time, mid_time) * 0.001f, absolute_time_diff_us(mid_time, get_absolute_time()) * 0.001f);
+        GolStats stats = gol_stats();
+        if (stats.valid) {
+            printf("Gen %d Compute %.2fms, draw %.2fms, %d alive (+%d -%d), %d rows changed\n", gol.gen_count, absolute_time_diff_us(start_time, mid_time) * 0.001f, absolute_time_diff_us(mid_time, get_absolute_time()) * 0.001f,
+                   stats.live, stats.births, stats.deaths, stats.changed_rows);
+        }
+        else {
+            printf("Gen %d Compute %.2fms, draw %.2fms\n", gol.gen_count, absolute_time_diff_us(start_time, mid_time) * 0.001f, absolute_time_diff_us(mid_time, get_absolute_time()) * 0.001f);
+        }
         display.flip_async();
     }
 }
@@ -0,0 +1,174 @@
+// Fixed point arithmetic used by the generators
+
+#pragma once
+
+#include <math.h>
+#include "mandelbrot.h"
+
+// Statistics for the calling core
+static inline FractalStats* fractal_core_stats(FractalBuffer* f)
+{
+  return &f->core_stats[get_core_num()];
+}
+
+#define ESCAPE_SQUARE (4<<26)
+
+// Fraction of an iteration to add to the escape count for smooth colouring in
+// 1/256ths, indexed by |z|^2 - 4 at escape in units of 1/8.  Set up by mandel_init.
+extern uint8_t smooth_fraction[256];
+
+// Store value for a pixel, counting it in the statistics under histogram entry
+// key.  Every pixel set while generating goes through here or copy_pixel.
+static inline void store_pixel(FractalBuffer* f, uint8_t* buffptr, uint8_t value, uint32_t key)
+{
+  FractalStats* stats = fractal_core_stats(f);
+  if (value == 0) stats->count_inside++;
+  else {
+    if (stats->min_iter > key) stats->min_iter = key;
+    stats->histogram[key]++;
+    stats->value_keys[value] = key;
+  }
+  *buffptr = value;
+}
+
+// Store a copy of another pixel's value, counted as that pixel was
+static inline void copy_pixel(FractalBuffer* f, uint8_t* buffptr, uint8_t value)
+{
+  const uint32_t key = fractal_core_stats(f)->value_keys[value];
+  store_pixel(f, buffptr, value, key ? key : value);
+}
+
+static inline void set_inside(FractalBuffer* f, uint8_t* buffptr, uint32_t iterations)
+{
+  fractal_core_stats(f)->count_iterations += iterations;
+  store_pixel(f, buffptr, 0, 0);
+}
+
+// Count the iterations of a pixel that escaped after k iterations, returning its
+// histogram entry, which is the value to store for it without smooth colouring
+static inline uint32_t escape_key(FractalBuffer* f, uint32_t k)
+{
+  fractal_core_stats(f)->count_iterations += k;
+  if (k > f->iter_offset) k -= f->iter_offset;
+  else k = 1;
+  if (k >= FRACTAL_UNKNOWN) k = FRACTAL_UNKNOWN - 1;
+  return k;
+}
+
+// Store the pixel that escaped after k iterations with |z|^2 = mag
+static inline void set_escaped(FractalBuffer* f, uint8_t* buffptr, uint32_t k, fixed_pt_t mag)
+{
+  k = escape_key(f, k);
+
+  uint32_t value = k;
+  if (f->smooth_map) {
+    // Magnitudes that overflowed wrap below the escape radius, and get no fraction
+    const uint32_t idx = (uint32_t)(mag - ESCAPE_SQUARE) >> 23;
+    const uint32_t frac = smooth_fraction[idx > 255 ? 255 : idx];
+    const uint16_t* map = f->smooth_map;
+    value = (map[k] + (((map[k + 1] - map[k]) * frac) >> 8)) >> 8;
+  }
+  store_pixel(f, buffptr, value, k);
+}
+
+// log2 of the distance estimate |z| ln|z| / |dz|, from |z|^2 = mag and
+// |dz|^2 = dz_mag * 2^(2 * dz_exp) at escape
+static inline float distance_log2(float mag, float dz_mag, int32_t dz_exp)
+{
+  return 0.5f * log2f(mag / dz_mag) + log2f(0.5f * logf(mag)) - dz_exp;
+}
+
+// Store the distance estimate for the pixel that escaped after k iterations
+static inline void set_distance(FractalBuffer* f, uint8_t* buffptr, uint32_t k, float log2_distance)
+{
+  k = escape_key(f, k);
+  const int32_t d = DISTANCE_ONE_PIXEL + (int32_t)floorf((log2_distance - f->log2_inc) * DISTANCE_STEPS_PER_OCTAVE);
+  store_pixel(f, buffptr, (d < 1) ? 1 : (d >= FRACTAL_UNKNOWN) ? FRACTAL_UNKNOWN - 1 : d, k);
+}
+
+// Derivatives are kept below this, scaled by a power of 2, so that 2 z dz + 1
+// stays in range for |z| <= 2
+#define DERIVATIVE_LIMIT (4<<26)
+
+// Set to 1 to compute the products exactly, rounding down, with a 64-bit multiply.
+// This is much slower on the RP2040, and is for measuring the error of the fast
+// versions below on the host, see mandel_accuracy.
+#ifndef FIXED_PT_EXACT
+#define FIXED_PT_EXACT 0
+#endif
+
+#if FIXED_PT_EXACT
+static inline fixed_pt_t mul(fixed_pt_t a, fixed_pt_t b)
+{
+  return (fixed_pt_t)(((int64_t)a * b) >> 26);
+}
+
+// a * b * 2
+static inline fixed_pt_t mul2(fixed_pt_t a, fixed_pt_t b)
+{
+  return (fixed_pt_t)(((int64_t)a * b) >> 25);
+}
+
+static inline fixed_pt_t square(fixed_pt_t a) {
+  return (fixed_pt_t)(((int64_t)a * a) >> 26);
+}
+#else
+static inline fixed_pt_t mul(fixed_pt_t a, fixed_pt_t b)
+{
+  int32_t ah = a >> 13;
+  int32_t al = a & 0x1fff;
+  int32_t bh = b >> 13;
+  int32_t bl = b & 0x1fff;
+
+  // Ignore al * bl as contribution to final result is only the carry.
+  fixed_pt_t r = ((ah * bl) + (al * bh)) >> 13;
+  r += ah * bh;
+  return r;
+}
+
+// a * b * 2
+static inline fixed_pt_t mul2(fixed_pt_t a, fixed_pt_t b)
+{
+  int32_t ah = a >> 12;
+  int32_t al = (a & 0xfff) << 1;
+  int32_t bh = b >> 13;
+  int32_t bl = b & 0x1fff;
+
+  fixed_pt_t r = ((ah * bl) + (al * bh)) >> 13;
+  r += ah * bh;
+  return r;
+}
+
+static inline fixed_pt_t square(fixed_pt_t a) {
+  int32_t ah = a >> 13;
+  int32_t al = a & 0x1fff;
+
+  return ((ah * al) >> 12) + (ah * ah);
+}
+#endif
+
+// 64-bit fixed point with 6 bits to the left of the point, precision 2^-58
+typedef int64_t fixed64_t;
+
+#define ESCAPE_SQUARE64 ((int64_t)4<<58)
+
+// Multiplies built from 32x32 bit products, the low words are unsigned.
+static inline fixed64_t mul64(fixed64_t a, fixed64_t b)
+{
+  int32_t ah = a >> 32;
+  uint32_t al = (uint32_t)a;
+  int32_t bh = b >> 32;
+  uint32_t bl = (uint32_t)b;
+
+  int64_t mid = (int64_t)ah * bl + (int64_t)al * bh + (int64_t)(((uint64_t)al * bl) >> 32);
+  return ((int64_t)ah * bh << 6) + (mid >> 26);
+}
+
+static inline fixed64_t square64(fixed64_t a)
+{
+  int32_t ah = a >> 32;
+  uint32_t al = (uint32_t)a;
+
+  int64_t mid = ((int64_t)ah * al << 1) + (int64_t)(((uint64_t)al * al) >> 32);
+  return ((int64_t)ah * ah << 6) + (mid >> 26);
+}
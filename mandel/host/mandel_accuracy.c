@@ -0,0 +1,235 @@
+// Compare the generators against the vectorised double reference over one view,
+// to see how much precision the fixed point multiplies lose.  For each generator
+// the pixels that escape earlier or later than in double, or disagree about
+// being inside, are counted, and the throughput of each is measured.  The
+// differences for 32-bit fixed point are written to map as a PGM image: mid
+// grey where it agrees, lighter where it escapes later and darker where it
+// escapes earlier, by 16 levels per iteration, with white for pixels only it
+// finds inside and black for those only the reference does.
+//
+//   mandel_accuracy [minx maxx miny maxy [max_iter [map]]]
+//
+// The default is the initial view of the PicoVision demo, written to
+// accuracy_map.pgm.  Build with FIXED_PT_EXACT set, as mandel_accuracy_exact
+// is, to compare against products computed exactly.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pico/stdlib.h"
+#include "mandelbrot.h"
+#include "fixed_pt.h"
+#include "simd_reference.h"
+
+#define WIDTH 720
+#define HEIGHT 240
+
+// Each configuration is run repeatedly for at least this long when timing it
+#define MIN_TIME_MS 100.0
+
+static uint16_t reference[HEIGHT][WIDTH];
+static uint16_t float_counts[HEIGHT][WIDTH];
+static uint8_t result[HEIGHT][WIDTH];
+static uint8_t map[HEIGHT][WIDTH];
+
+typedef struct {
+  const char* name;
+  uint8_t precision;
+} AccuracyConfig;
+
+static const AccuracyConfig configs[] = {
+  { "32-bit fixed", PRECISION_FIXED32 },
+  { "64-bit fixed", PRECISION_FIXED64 },
+  { "float",        PRECISION_FLOAT   },
+  { "double",       PRECISION_DOUBLE  },
+};
+#define NUM_CONFIGS (sizeof(configs) / sizeof(configs[0]))
+
+// Differences from the reference for one configuration
+typedef struct {
+  int later;           // Escaped later than the reference
+  int earlier;         // Escaped earlier
+  int inside_only;     // Inside, but the reference escaped
+  int escaped_only;    // Escaped, but the reference is inside
+  int max_diff;        // Largest difference in escape count
+  uint64_t total_diff; // Sum of the differences in escape count
+} Differences;
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec * 0.000001;
+}
+
+static void run(FractalBuffer* f, const AccuracyConfig* config) {
+  f->precision = config->precision;
+  init_fractal(f);
+  for (int y = 0; y < HEIGHT; ++y) {
+    generate_one_line(f, result[y], y);
+  }
+  fractal_merge_stats(f);
+}
+
+static uint64_t run_simd(const FractalBuffer* f, bool use_float, uint16_t counts[HEIGHT][WIDTH]) {
+  uint64_t iterations = 0;
+  for (int y = 0; y < HEIGHT; ++y) {
+    iterations += use_float ? simd_reference_line_float(f, counts[y], y) : simd_reference_line_double(f, counts[y], y);
+  }
+  return iterations;
+}
+
+// Buffer value the generators store for an escape count, as escape_key does
+static int count_to_value(const FractalBuffer* f, int k) {
+  if (k >= f->max_iter) return 0;
+  k = (k > f->iter_offset) ? k - f->iter_offset : 1;
+  return (k >= FRACTAL_UNKNOWN) ? FRACTAL_UNKNOWN - 1 : k;
+}
+
+// Compare the buffer value for each pixel, given by value, against the reference,
+// recording the differences in out_map if it isn't NULL.
+static void compare(const FractalBuffer* f, int (*value)(int x, int y), Differences* d, uint8_t out_map[HEIGHT][WIDTH]) {
+  memset(d, 0, sizeof(*d));
+  for (int y = 0; y < HEIGHT; ++y) {
+    for (int x = 0; x < WIDTH; ++x) {
+      const int ref = count_to_value(f, reference[y][x]);
+      const int k = value(x, y);
+      int shade = 128;
+      if (k == 0 && ref != 0) {
+        ++d->inside_only;
+        shade = 255;
+      }
+      else if (k != 0 && ref == 0) {
+        ++d->escaped_only;
+        shade = 0;
+      }
+      else if (k != ref) {
+        const int diff = k - ref;
+        if (diff > 0) ++d->later;
+        else ++d->earlier;
+        if (abs(diff) > d->max_diff) d->max_diff = abs(diff);
+        d->total_diff += abs(diff);
+        shade = 128 + diff * 16;
+        if (shade < 1) shade = 1;
+        if (shade > 254) shade = 254;
+      }
+      if (out_map) out_map[y][x] = shade;
+    }
+  }
+}
+
+static int result_value(int x, int y) { return result[y][x]; }
+
+static const FractalBuffer* float_view;
+static int float_value(int x, int y) { return count_to_value(float_view, float_counts[y][x]); }
+
+static void print_row(const char* name, double ms, uint64_t iterations, const Differences* d) {
+  const int differ = d->later + d->earlier + d->inside_only + d->escaped_only;
+  const int escape_differ = d->later + d->earlier;
+  printf("%-20s %9.2f %9.1f %9.1f %8d %8d %8d %8d %8d %9.2f %6d\n", name, ms,
+         WIDTH * HEIGHT / (ms * 1000.0), iterations / (ms * 1000.0), differ,
+         d->later, d->earlier, d->inside_only, d->escaped_only,
+         escape_differ ? (double)d->total_diff / escape_differ : 0.0, d->max_diff);
+}
+
+static bool write_map(const char* path) {
+  FILE* file = fopen(path, "wb");
+  if (!file) return false;
+  fprintf(file, "P5\n%d %d\n255\n", WIDTH, HEIGHT);
+  const bool ok = fwrite(map, 1, sizeof(map), file) == sizeof(map);
+  return fclose(file) == 0 && ok;
+}
+
+int main(int argc, char** argv) {
+  FractalBuffer f;
+  memset(&f, 0, sizeof(f));
+  f.rows = HEIGHT;
+  f.cols = WIDTH;
+  f.max_iter = 55;
+  f.minx = -2.25;
+  f.maxx = 0.75;
+  f.miny = -1.6;
+  f.maxy = 0. - (1.6 / (HEIGHT * 2));
+  f.cycle_check = CYCLE_CHECK_NONE;
+  const char* map_path = "accuracy_map.pgm";
+
+  if (argc >= 5) {
+    f.minx = atof(argv[1]);
+    f.maxx = atof(argv[2]);
+    f.miny = atof(argv[3]);
+    f.maxy = atof(argv[4]);
+  }
+  if (argc >= 6) f.max_iter = atoi(argv[5]);
+  if (argc >= 7) map_path = argv[6];
+
+  mandel_init();
+  f.precision = PRECISION_DOUBLE;
+  init_fractal(&f);
+  printf("View %.17g,%.17g to %.17g,%.17g, %d x %d, max_iter %d, %s products%s\n", f.minx, f.miny, f.maxx, f.maxy,
+         WIDTH, HEIGHT, f.max_iter, FIXED_PT_EXACT ? "exact" : "fast", FIXED_PT_EXACT ? "" : " (al * bl dropped)");
+
+  // Time the reference, repeating it so that it is long enough to measure
+  double start = now_ms(), elapsed;
+  int repeats = 0;
+  uint64_t iterations;
+  do {
+    iterations = run_simd(&f, false, reference);
+    ++repeats;
+  } while ((elapsed = now_ms() - start) < MIN_TIME_MS);
+  const double reference_ms = elapsed / repeats;
+  const uint64_t reference_iterations = iterations;
+
+  // Start the values at 1, as the demo's iter_offset does, so fewer are clamped
+  int min_escape = f.max_iter, clamped = 0;
+  for (int y = 0; y < HEIGHT; ++y) {
+    for (int x = 0; x < WIDTH; ++x) {
+      if (reference[y][x] < min_escape) min_escape = reference[y][x];
+    }
+  }
+  f.iter_offset = min_escape - 1;
+  for (int y = 0; y < HEIGHT; ++y) {
+    for (int x = 0; x < WIDTH; ++x) {
+      if (reference[y][x] < f.max_iter && reference[y][x] - f.iter_offset >= FRACTAL_UNKNOWN - 1) ++clamped;
+    }
+  }
+  printf("Reference is double with %s, %d pixels at once; iter_offset %d, %d escape counts clamped\n\n",
+         simd_instruction_set, simd_lanes_double, f.iter_offset, clamped);
+
+  printf("%-20s %9s %9s %9s %8s %8s %8s %8s %8s %9s %6s\n", "", "time (ms)", "Mpixel/s", "Miter/s", "differ",
+         "later", "earlier", "inside", "escaped", "mean diff", "max");
+  Differences d;
+  memset(&d, 0, sizeof(d));
+  print_row("vector double", reference_ms, reference_iterations, &d);
+
+  start = now_ms();
+  repeats = 0;
+  do {
+    iterations = run_simd(&f, true, float_counts);
+    ++repeats;
+  } while ((elapsed = now_ms() - start) < MIN_TIME_MS);
+  float_view = &f;
+  compare(&f, float_value, &d, NULL);
+  char name[32];
+  snprintf(name, sizeof(name), "vector float (x%d)", simd_lanes_float);
+  print_row(name, elapsed / repeats, iterations, &d);
+
+  for (unsigned i = 0; i < NUM_CONFIGS; ++i) {
+    start = now_ms();
+    repeats = 0;
+    do {
+      run(&f, &configs[i]);
+      ++repeats;
+    } while ((elapsed = now_ms() - start) < MIN_TIME_MS);
+
+    compare(&f, result_value, &d, (configs[i].precision == PRECISION_FIXED32) ? map : NULL);
+    print_row(configs[i].name, elapsed / repeats, f.stats.count_iterations, &d);
+  }
+
+  if (!write_map(map_path)) {
+    fprintf(stderr, "Couldn't write %s\n", map_path);
+    return 1;
+  }
+  printf("\nDifferences for 32-bit fixed point written to %s\n", map_path);
+  return 0;
+}
@@ -0,0 +1,271 @@
+// Run the Mandelbrot generators on the host over one view, reporting the time
+// taken and iterations done by each configuration, and how many pixels differ
+// from plain iteration in 32-bit fixed point and in double precision.
+// Solid guessing is then compared against computing every pixel, and distance
+// estimation in fixed point against double.  Lastly it checks that every pixel
+// is counted in the statistics when filling tiles or guessing, and that the detail
+// score used to steer the zoom picks out the boundary of the set on the initial
+// view, exiting with 1 if not.
+//
+//   mandel_bench [minx maxx miny maxy [max_iter]]
+//
+// The default is the initial view of the PicoVision demo.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "pico/stdlib.h"
+#include "mandelbrot.h"
+
+#define WIDTH 720
+#define HEIGHT 240
+
+static uint8_t reference[HEIGHT][WIDTH];
+static uint8_t double_reference[HEIGHT][WIDTH];
+static uint8_t result[HEIGHT][WIDTH];
+
+typedef struct {
+  const char* name;
+  uint8_t cycle_check;
+  bool use_bulb_check;
+  uint8_t precision;
+} BenchConfig;
+
+static const BenchConfig configs[] = {
+  { "plain",               CYCLE_CHECK_NONE,  false, PRECISION_FIXED32 },
+  { "bulb check",          CYCLE_CHECK_NONE,  true,  PRECISION_FIXED32 },
+  { "fixed cycle check",   CYCLE_CHECK_FIXED, false, PRECISION_FIXED32 },
+  { "Brent cycle check",   CYCLE_CHECK_BRENT, false, PRECISION_FIXED32 },
+  { "fixed + bulb check",  CYCLE_CHECK_FIXED, true,  PRECISION_FIXED32 },
+  { "Brent + bulb check",  CYCLE_CHECK_BRENT, true,  PRECISION_FIXED32 },
+  { "64-bit plain",        CYCLE_CHECK_NONE,  false, PRECISION_FIXED64 },
+  { "64-bit fixed check",  CYCLE_CHECK_FIXED, false, PRECISION_FIXED64 },
+  { "64-bit Brent",        CYCLE_CHECK_BRENT, false, PRECISION_FIXED64 },
+  { "float plain",         CYCLE_CHECK_NONE,  false, PRECISION_FLOAT   },
+  { "float fixed check",   CYCLE_CHECK_FIXED, false, PRECISION_FLOAT   },
+  { "float Brent",         CYCLE_CHECK_BRENT, false, PRECISION_FLOAT   },
+  { "double Brent",        CYCLE_CHECK_BRENT, false, PRECISION_DOUBLE  },
+};
+static const BenchConfig double_config = { "double plain", CYCLE_CHECK_NONE, false, PRECISION_DOUBLE };
+static const BenchConfig guess_config = { "solid guessing", CYCLE_CHECK_FIXED, true, PRECISION_FIXED32 };
+static const BenchConfig distance_configs[] = {
+  { "32-bit distance",     CYCLE_CHECK_NONE,  true,  PRECISION_FIXED32 },
+  { "64-bit distance",     CYCLE_CHECK_NONE,  false, PRECISION_FIXED64 },
+  { "double distance",     CYCLE_CHECK_NONE,  false, PRECISION_DOUBLE  },
+};
+#define NUM_DISTANCE_CONFIGS (sizeof(distance_configs) / sizeof(distance_configs[0]))
+#define NUM_CONFIGS (sizeof(configs) / sizeof(configs[0]))
+
+static double now_ms(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000.0 + ts.tv_nsec * 0.000001;
+}
+
+static void run(FractalBuffer* f, const BenchConfig* config, uint8_t buf[HEIGHT][WIDTH]) {
+  f->cycle_check = config->cycle_check;
+  f->use_bulb_check = config->use_bulb_check;
+  f->precision = config->precision;
+  init_fractal(f);
+  for (int y = 0; y < HEIGHT; ++y) {
+    generate_one_line(f, buf[y], y);
+  }
+  fractal_merge_stats(f);
+}
+
+// As run, but with solid guessing: even rows first, then the rows between them
+static void run_guessed(FractalBuffer* f, const BenchConfig* config, uint8_t buf[HEIGHT][WIDTH]) {
+  f->cycle_check = config->cycle_check;
+  f->use_bulb_check = config->use_bulb_check;
+  f->precision = config->precision;
+  init_fractal(f);
+  memset(buf, FRACTAL_UNKNOWN, HEIGHT * WIDTH);
+  for (int y = 0; y < HEIGHT; y += 2) {
+    guess_missing_in_line(f, buf[y], y);
+  }
+  for (int y = 1; y < HEIGHT; y += 2) {
+    guess_line_between(f, buf[y], buf[y - 1], (y + 1 < HEIGHT) ? buf[y + 1] : NULL, y);
+  }
+  fractal_merge_stats(f);
+}
+
+// As run, but in tiles as the demo does by default
+#define TILE_SIZE 48
+static void run_tiled(FractalBuffer* f, const BenchConfig* config, uint8_t buf[HEIGHT][WIDTH]) {
+  f->cycle_check = config->cycle_check;
+  f->use_bulb_check = config->use_bulb_check;
+  f->precision = config->precision;
+  init_fractal(f);
+  memset(buf, FRACTAL_UNKNOWN, HEIGHT * WIDTH);
+  for (int y = 0; y < HEIGHT; y += TILE_SIZE) {
+    for (int x = 0; x < WIDTH; x += TILE_SIZE) {
+      generate_rect(f, &buf[0][0], WIDTH, x, y, TILE_SIZE, (y + TILE_SIZE <= HEIGHT) ? TILE_SIZE : HEIGHT - y);
+    }
+  }
+  fractal_merge_stats(f);
+}
+
+// The iteration tuner and the smooth colouring rely on every pixel being
+// counted, either as inside or in the histogram.  Returns whether they are.
+static bool check_histogram(const FractalBuffer* f, const char* name) {
+  uint32_t total = f->stats.count_inside;
+  for (int i = 0; i < 256; ++i) total += f->stats.histogram[i];
+  printf("%s: %u of %d pixels counted\n", name, total, WIDTH * HEIGHT);
+  if (total == WIDTH * HEIGHT) return true;
+  fprintf(stderr, "FAILED: %s counted %u pixels instead of %d\n", name, total, WIDTH * HEIGHT);
+  return false;
+}
+
+// The demo steers its zoom towards the square with the highest detail score.  On
+// the initial view that must be on the boundary, holding both inside and escaped
+// pixels, and squares that are all inside or all escaped must score zero.
+// Returns whether they do.
+#define DETAIL_TILE 16
+static bool check_detail_score(void) {
+  FractalBuffer f;
+  memset(&f, 0, sizeof(f));
+  f.rows = HEIGHT;
+  f.cols = WIDTH;
+  f.max_iter = 55;
+  f.minx = -2.25;
+  f.maxx = 0.75;
+  f.miny = -1.6;
+  f.maxy = 0. - (1.6 / (HEIGHT * 2));
+  run(&f, &guess_config, result);
+
+  // Inside the main cardioid left of -0.25, and escaping at once around -2.2-1.55i
+  const uint32_t inside = fractal_detail_score(&result[0][0], WIDTH, HEIGHT, 464, 224, DETAIL_TILE);
+  const uint32_t outside = fractal_detail_score(&result[0][0], WIDTH, HEIGHT, 0, 0, DETAIL_TILE);
+
+  uint32_t best = 0;
+  int best_x = 0, best_y = 0;
+  for (int y = 0; y + DETAIL_TILE <= HEIGHT; y += DETAIL_TILE) {
+    for (int x = 0; x + DETAIL_TILE <= WIDTH; x += DETAIL_TILE) {
+      const uint32_t score = fractal_detail_score(&result[0][0], WIDTH, HEIGHT, x, y, DETAIL_TILE);
+      if (score > best) {
+        best = score;
+        best_x = x;
+        best_y = y;
+      }
+    }
+  }
+  bool has_inside = false, has_escaped = false;
+  for (int y = best_y; y < best_y + DETAIL_TILE; ++y) {
+    for (int x = best_x; x < best_x + DETAIL_TILE; ++x) {
+      if (result[y][x] == 0) has_inside = true;
+      else has_escaped = true;
+    }
+  }
+
+  printf("Detail score: %u inside, %u outside, best %u of %d at (%d, %d)\n", inside, outside, best,
+         2 * DETAIL_TILE * DETAIL_TILE - DETAIL_TILE, best_x, best_y);
+  if (inside == 0 && outside == 0 && has_inside && has_escaped) return true;
+  fprintf(stderr, "FAILED: detail score doesn't pick out the boundary\n");
+  return false;
+}
+
+int main(int argc, char** argv) {
+  FractalBuffer f;
+  memset(&f, 0, sizeof(f));
+  f.rows = HEIGHT;
+  f.cols = WIDTH;
+  f.max_iter = 55;
+  f.minx = -2.25;
+  f.maxx = 0.75;
+  f.miny = -1.6;
+  f.maxy = 0. - (1.6 / (HEIGHT * 2));
+
+  if (argc >= 5) {
+    f.minx = atof(argv[1]);
+    f.maxx = atof(argv[2]);
+    f.miny = atof(argv[3]);
+    f.maxy = atof(argv[4]);
+  }
+  if (argc >= 6) f.max_iter = atoi(argv[5]);
+
+  mandel_init();
+  printf("View %.17g,%.17g to %.17g,%.17g, %d x %d, max_iter %d\n", f.minx, f.miny, f.maxx, f.maxy, WIDTH, HEIGHT, f.max_iter);
+
+  f.precision = PRECISION_AUTO;
+  init_fractal(&f);
+  printf("Automatic precision: %s\n", f.precision_used == PRECISION_FIXED32 ? "32-bit fixed" : "64-bit fixed");
+
+  run(&f, &double_config, double_reference);
+  printf("%-24s %10s %14s %10s %10s %10s %8s %10s\n", "", "time (ms)", "iterations", "per row", "saved", "inside", "differ", "vs double");
+
+  uint64_t plain_iterations = 0;
+  for (unsigned i = 0; i < NUM_CONFIGS; ++i) {
+    double start = now_ms();
+    run(&f, &configs[i], i == 0 ? reference : result);
+    double elapsed = now_ms() - start;
+
+    int differ = 0, differ_double = 0;
+    if (i == 0) plain_iterations = f.stats.count_iterations;
+    uint8_t (*buf)[WIDTH] = (i == 0) ? reference : result;
+    for (int y = 0; y < HEIGHT; ++y) {
+      for (int x = 0; x < WIDTH; ++x) {
+        if (buf[y][x] != reference[y][x]) ++differ;
+        if (buf[y][x] != double_reference[y][x]) ++differ_double;
+      }
+    }
+
+    printf("%-24s %10.2f %14u %10u %9.1f%% %10u %8d %10d\n", configs[i].name, elapsed, f.stats.count_iterations, f.stats.count_iterations / HEIGHT,
+           100.0 * (1.0 - (double)f.stats.count_iterations / plain_iterations), f.stats.count_inside, differ, differ_double);
+  }
+
+  // The same configuration computing every pixel is the reference for solid guessing
+  run(&f, &guess_config, reference);
+  const uint32_t full_iterations = f.stats.count_iterations;
+  double start = now_ms();
+  run_guessed(&f, &guess_config, result);
+  double elapsed = now_ms() - start;
+
+  int differ = 0, max_diff = 0;
+  for (int y = 0; y < HEIGHT; ++y) {
+    for (int x = 0; x < WIDTH; ++x) {
+      const int diff = abs(result[y][x] - reference[y][x]);
+      if (diff) ++differ;
+      if (diff > max_diff) max_diff = diff;
+    }
+  }
+  printf("\nSolid guessing (fixed + bulb check): %.2fms, %u iterations (%.1f%% saved), computed %u and guessed %u of %d pixels,\n"
+         "%d pixels differ from computing every pixel, by up to %d\n",
+         elapsed, f.stats.count_iterations, 100.0 * (1.0 - (double)f.stats.count_iterations / full_iterations),
+         f.stats.count_computed, f.stats.count_guessed, WIDTH * HEIGHT, differ, max_diff);
+
+  // Distance estimates are compared against double, in steps of 1/16 of an octave
+  f.distance_estimate = true;
+  run(&f, &distance_configs[NUM_DISTANCE_CONFIGS - 1], double_reference);
+  printf("\n%-24s %10s %14s %10s %10s %10s\n", "", "time (ms)", "iterations", "inside", "differ", "by > 1");
+  for (unsigned i = 0; i < NUM_DISTANCE_CONFIGS; ++i) {
+    start = now_ms();
+    run(&f, &distance_configs[i], result);
+    elapsed = now_ms() - start;
+
+    int differ_one = 0;
+    differ = 0;
+    for (int y = 0; y < HEIGHT; ++y) {
+      for (int x = 0; x < WIDTH; ++x) {
+        const int diff = abs(result[y][x] - double_reference[y][x]);
+        if (diff) ++differ;
+        if (diff > 1) ++differ_one;
+      }
+    }
+    printf("%-24s %10.2f %14u %10u %10d %10d\n", distance_configs[i].name, elapsed, f.stats.count_iterations,
+           f.stats.count_inside, differ, differ_one);
+  }
+
+  // Check the statistics of the ways of filling pixels without computing them
+  f.distance_estimate = false;
+  printf("\n");
+  bool counted = true;
+  run_tiled(&f, &guess_config, result);
+  counted &= check_histogram(&f, "Tiles");
+  run_guessed(&f, &guess_config, result);
+  counted &= check_histogram(&f, "Solid guessing");
+  const bool detail = check_detail_score();
+
+  return (counted && detail) ? 0 : 1;
+}
@@ -0,0 +1,31 @@
+// Host emulation of the interpolators, only supporting the default
+// configuration, where the lane result is accumulator + base.
+
+#pragma once
+
+#include "pico/stdlib.h"
+
+typedef struct {
+  uint32_t accum[2];
+  uint32_t base[3];
+} interp_hw_t;
+
+typedef struct {
+  uint32_t ctrl;
+} interp_config;
+
+extern interp_hw_t host_interp[2];
+#define interp0 (&host_interp[0])
+#define interp1 (&host_interp[1])
+
+static inline interp_config interp_default_config(void) { interp_config c = {0}; return c; }
+static inline void interp_set_config(interp_hw_t* interp, uint lane, interp_config* config) { (void)interp; (void)lane; (void)config; }
+
+static inline void interp_set_base(interp_hw_t* interp, uint lane, uint32_t val) { interp->base[lane] = val; }
+static inline void interp_set_accumulator(interp_hw_t* interp, uint lane, uint32_t val) { interp->accum[lane] = val; }
+static inline uint32_t interp_get_accumulator(interp_hw_t* interp, uint lane) { return interp->accum[lane]; }
+
+static inline uint32_t interp_pop_lane_result(interp_hw_t* interp, uint lane) {
+  interp->accum[lane] += interp->base[lane];
+  return interp->accum[lane];
+}
@@ -0,0 +1,3 @@
+#include "hardware/interp.h"
+
+interp_hw_t host_interp[2];
@@ -0,0 +1,13 @@
+// Host stand in for the parts of the pico SDK used by the generators
+
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef unsigned int uint;
+
+#define PICO_ON_DEVICE 0
+#define NUM_CORES 2
+
+static inline uint get_core_num(void) { return 0; }
@@ -0,0 +1,77 @@
+// Vectorised plain iteration, included by simd_reference.c once for each type
+// with these defined:
+//   SIMD_KERNEL(name)     Name of the function for this type
+//   simd_real_t           The scalar type
+//   vec_t                 A vector of VEC_LANES simd_real_t
+//   VEC_LANES             Number of pixels computed at once
+//   VEC_SET1(a)           Vector with every lane a
+//   VEC_LOAD(p)           Vector from VEC_LANES values at p
+//   VEC_STORE(p, v)       Store v to VEC_LANES values at p
+//   VEC_ADD(a, b), VEC_SUB(a, b), VEC_MUL(a, b)
+//   VEC_LE(a, b)          Mask of the lanes where a <= b, as a vec_t
+//   VEC_AND(a, b)         Bitwise and, to combine masks or select from a mask
+//   VEC_ANY(m)            Whether any lane of mask m is set
+// and they are undefined again at the end.
+//
+// Lanes that have escaped carry on iterating, so may overflow to infinity and
+// NaN, but as NaN <= 4 is false they stay escaped.
+
+uint64_t SIMD_KERNEL(simd_reference_line)(const FractalBuffer* f, uint16_t* counts, int row)
+{
+  const vec_t escape = VEC_SET1(4);
+  const vec_t one = VEC_SET1(1);
+  const vec_t y0 = VEC_SET1((simd_real_t)(f->miny + row * f->incyd));
+  uint64_t total = 0;
+
+  for (int x = 0; x < f->cols; x += VEC_LANES) {
+    simd_real_t pos[VEC_LANES];
+    for (int i = 0; i < VEC_LANES; ++i) {
+      pos[i] = (simd_real_t)(f->minx + (x + i) * f->incxd);
+    }
+    const vec_t x0 = VEC_LOAD(pos);
+    const vec_t cx = f->julia ? VEC_SET1((simd_real_t)f->julia_cx) : x0;
+    const vec_t cy = f->julia ? VEC_SET1((simd_real_t)f->julia_cy) : y0;
+
+    // As in generate_one, a pixel escapes at k when z after k - 1 steps is
+    // outside the radius, so each lane counts from 1 while it is inside.
+    vec_t zx = x0;
+    vec_t zy = y0;
+    vec_t k = one;
+    vec_t active = VEC_LE(one, one);  // Every lane
+    for (int i = 1; i < f->max_iter; ++i) {
+      const vec_t x_square = VEC_MUL(zx, zx);
+      const vec_t y_square = VEC_MUL(zy, zy);
+      active = VEC_AND(active, VEC_LE(VEC_ADD(x_square, y_square), escape));
+      if (!VEC_ANY(active)) break;
+      k = VEC_ADD(k, VEC_AND(active, one));
+
+      const vec_t xy = VEC_MUL(zx, zy);
+      zy = VEC_ADD(VEC_ADD(xy, xy), cy);
+      zx = VEC_ADD(VEC_SUB(x_square, y_square), cx);
+    }
+
+    simd_real_t result[VEC_LANES];
+    VEC_STORE(result, k);
+    for (int i = 0; i < VEC_LANES && x + i < f->cols; ++i) {
+      counts[x + i] = (uint16_t)result[i];
+      total += counts[x + i];
+    }
+  }
+  return total;
+}
+
+const int SIMD_KERNEL(simd_lanes) = VEC_LANES;
+
+#undef SIMD_KERNEL
+#undef simd_real_t
+#undef vec_t
+#undef VEC_LANES
+#undef VEC_SET1
+#undef VEC_LOAD
+#undef VEC_STORE
+#undef VEC_ADD
+#undef VEC_SUB
+#undef VEC_MUL
+#undef VEC_LE
+#undef VEC_AND
+#undef VEC_ANY
@@ -0,0 +1,106 @@
+#include "simd_reference.h"
+
+#if defined(__AVX__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX__)
+const char* const simd_instruction_set = "AVX";
+
+#define SIMD_KERNEL(name) name##_double
+#define simd_real_t double
+#define vec_t __m256d
+#define VEC_LANES 4
+#define VEC_SET1(a) _mm256_set1_pd(a)
+#define VEC_LOAD(p) _mm256_loadu_pd(p)
+#define VEC_STORE(p, v) _mm256_storeu_pd(p, v)
+#define VEC_ADD(a, b) _mm256_add_pd(a, b)
+#define VEC_SUB(a, b) _mm256_sub_pd(a, b)
+#define VEC_MUL(a, b) _mm256_mul_pd(a, b)
+#define VEC_LE(a, b) _mm256_cmp_pd(a, b, _CMP_LE_OQ)
+#define VEC_AND(a, b) _mm256_and_pd(a, b)
+#define VEC_ANY(m) _mm256_movemask_pd(m)
+#include "simd_kernel.h"
+
+#define SIMD_KERNEL(name) name##_float
+#define simd_real_t float
+#define vec_t __m256
+#define VEC_LANES 8
+#define VEC_SET1(a) _mm256_set1_ps(a)
+#define VEC_LOAD(p) _mm256_loadu_ps(p)
+#define VEC_STORE(p, v) _mm256_storeu_ps(p, v)
+#define VEC_ADD(a, b) _mm256_add_ps(a, b)
+#define VEC_SUB(a, b) _mm256_sub_ps(a, b)
+#define VEC_MUL(a, b) _mm256_mul_ps(a, b)
+#define VEC_LE(a, b) _mm256_cmp_ps(a, b, _CMP_LE_OQ)
+#define VEC_AND(a, b) _mm256_and_ps(a, b)
+#define VEC_ANY(m) _mm256_movemask_ps(m)
+#include "simd_kernel.h"
+
+#elif defined(__SSE2__)
+const char* const simd_instruction_set = "SSE2";
+
+#define SIMD_KERNEL(name) name##_double
+#define simd_real_t double
+#define vec_t __m128d
+#define VEC_LANES 2
+#define VEC_SET1(a) _mm_set1_pd(a)
+#define VEC_LOAD(p) _mm_loadu_pd(p)
+#define VEC_STORE(p, v) _mm_storeu_pd(p, v)
+#define VEC_ADD(a, b) _mm_add_pd(a, b)
+#define VEC_SUB(a, b) _mm_sub_pd(a, b)
+#define VEC_MUL(a, b) _mm_mul_pd(a, b)
+#define VEC_LE(a, b) _mm_cmple_pd(a, b)
+#define VEC_AND(a, b) _mm_and_pd(a, b)
+#define VEC_ANY(m) _mm_movemask_pd(m)
+#include "simd_kernel.h"
+
+#define SIMD_KERNEL(name) name##_float
+#define simd_real_t float
+#define vec_t __m128
+#define VEC_LANES 4
+#define VEC_SET1(a) _mm_set1_ps(a)
+#define VEC_LOAD(p) _mm_loadu_ps(p)
+#define VEC_STORE(p, v) _mm_storeu_ps(p, v)
+#define VEC_ADD(a, b) _mm_add_ps(a, b)
+#define VEC_SUB(a, b) _mm_sub_ps(a, b)
+#define VEC_MUL(a, b) _mm_mul_ps(a, b)
+#define VEC_LE(a, b) _mm_cmple_ps(a, b)
+#define VEC_AND(a, b) _mm_and_ps(a, b)
+#define VEC_ANY(m) _mm_movemask_ps(m)
+#include "simd_kernel.h"
+
+#else
+// One pixel at a time, masks are 0 or 1
+const char* const simd_instruction_set = "none";
+
+#define SIMD_KERNEL(name) name##_double
+#define simd_real_t double
+#define vec_t double
+#define VEC_LANES 1
+#define VEC_SET1(a) ((double)(a))
+#define VEC_LOAD(p) (*(p))
+#define VEC_STORE(p, v) (*(p) = (v))
+#define VEC_ADD(a, b) ((a) + (b))
+#define VEC_SUB(a, b) ((a) - (b))
+#define VEC_MUL(a, b) ((a) * (b))
+#define VEC_LE(a, b) ((double)((a) <= (b)))
+#define VEC_AND(a, b) ((a) * (b))
+#define VEC_ANY(m) ((m) != 0)
+#include "simd_kernel.h"
+
+#define SIMD_KERNEL(name) name##_float
+#define simd_real_t float
+#define vec_t float
+#define VEC_LANES 1
+#define VEC_SET1(a) ((float)(a))
+#define VEC_LOAD(p) (*(p))
+#define VEC_STORE(p, v) (*(p) = (v))
+#define VEC_ADD(a, b) ((a) + (b))
+#define VEC_SUB(a, b) ((a) - (b))
+#define VEC_MUL(a, b) ((a) * (b))
+#define VEC_LE(a, b) ((float)((a) <= (b)))
+#define VEC_AND(a, b) ((a) * (b))
+#define VEC_ANY(m) ((m) != 0)
+#include "simd_kernel.h"
+#endif
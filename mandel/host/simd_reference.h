@@ -0,0 +1,22 @@
+// Vectorised floating point reference generators for the host, to check the
+// fixed point generators against and to measure how fast a PC computes the set.
+// They use AVX where the compiler targets it, otherwise SSE2, or plain C on
+// other CPUs.
+
+#pragma once
+
+#include "pico/stdlib.h"
+#include "mandelbrot.h"
+
+// Escape counts for a row of the view in f by plain iteration in double or float,
+// several pixels at a time.  counts is set to the iteration each pixel escaped
+// at, or max_iter if it didn't, without any offset or clamping, and the sum of
+// the counts is returned, which matches count_iterations for plain iteration.
+// Julia sets are supported, other options in f are ignored.
+uint64_t simd_reference_line_double(const FractalBuffer* f, uint16_t* counts, int row);
+uint64_t simd_reference_line_float(const FractalBuffer* f, uint16_t* counts, int row);
+
+// Pixels computed at once by each, for reporting
+extern const int simd_lanes_double;
+extern const int simd_lanes_float;
+extern const char* const simd_instruction_set;
@@ -1,33 +1,184 @@
 #include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <algorithm>
 #include "hardware/uart.h"
 #include "pico/multicore.h"
+#include "pico/sync.h"
 #include "drivers/dv_display/dv_display.hpp"
 #include "libraries/pico_graphics/pico_graphics_dv.hpp"
 
 extern "C" {
 #include "mandelbrot.h"
+#include "perturb.h"
 }
 
 using namespace pimoroni;
 
 #define FRAME_WIDTH 720
 #define FRAME_HEIGHT 480
+#define PSRAM_BANK_SIZE (8 * 1024 * 1024)
 
 class MirroredDVDisplay : public DVDisplay
 {
 public:
     MirroredDVDisplay(uint16_t width, uint16_t height)
         : DVDisplay()
-    {}
+    {
+        // Until set_line_rows is called the bottom half mirrors the top half
+        for (int i = 0; i < FRAME_HEIGHT; ++i) {
+            line_rows[i] = (i < FRAME_HEIGHT / 2) ? i : FRAME_HEIGHT - 1 - i;
+        }
+    }
 
     void set_scroll_idx_for_lines(int idx, int miny, int maxy) override;
+
+    // Show each row that is a multiple of repeat on the following repeat - 1 lines
+    // as well, so coarse passes only need to draw those rows.
+    void set_line_repeat(int repeat) {
+        line_repeat = repeat;
+        write_frame_table();
+    }
+
+    // Set the row of the frame shown on each line, this takes effect when the frame
+    // table is next written.
+    void set_line_rows(const int16_t* rows) {
+        memcpy(line_rows, rows, sizeof(line_rows));
+    }
+
+    // The frame table can point lines at any row of pixels in PSRAM, so the space
+    // after the frame can hold other rows.  This shows rows from offset bytes into
+    // that space, stride bytes apart, instead of the rows of the frame, until
+    // show_frame_rows is called.  Either takes effect when the frame table is next
+    // written.
+    void show_spare_rows(uint32_t offset, uint32_t stride) {
+        spare_offset = offset;
+        spare_stride = stride;
+    }
+    void show_frame_rows() {
+        spare_stride = 0;
+    }
+
+    // Bytes of PSRAM after the frame in each bank
+    uint32_t spare_bytes() const {
+        return PSRAM_BANK_SIZE - base_address - frame_height * frame_width * 3;
+    }
+
+    // Position to write to for offset bytes into the space after the frame
+    Point spare_point(uint32_t offset, int bytes_per_pixel) const {
+        const uint32_t row_bytes = frame_width * 3;
+        offset += frame_height * row_bytes;
+        return Point((offset % row_bytes) / bytes_per_pixel, offset / row_bytes);
+    }
+
+    // Show the bottom half of the screen as the top half rotated by 180 degrees,
+    // instead of mirrored.  The frame table can't reverse a row, so the reversed
+    // rows must be drawn to the bottom half of the frame.
+    void set_rotated(bool rotate) {
+        rotated = rotate;
+        write_frame_table();
+    }
+
+private:
+    void write_frame_table();
+
+    int16_t line_rows[FRAME_HEIGHT];
+    uint32_t spare_offset = 0;
+    uint32_t spare_stride = 0;
+    int line_repeat = 1;
+    bool rotated = false;
 };
 
+// Set to 1 to draw in RGB555 with smooth colouring: the fraction of an iteration at
+// escape removes the bands between iteration counts, and the colours are spread
+// evenly over the pixels using the histogram of the previous frame.  The buffer then
+// holds positions along the gradient instead of iteration counts.
+#define SMOOTH_COLOUR 0
+
+// Set to 1 to shade by the estimated distance to the set instead of the iteration
+// count, which shows the boundary crisply even with few iterations.  Pixels closer
+// than DISTANCE_DARK are darkest, fading out by DISTANCE_LIGHT, which are stored
+// distances as described for DISTANCE_ONE_PIXEL.
+#define DISTANCE_ESTIMATE 0
+#define DISTANCE_DARK (DISTANCE_ONE_PIXEL - 2 * DISTANCE_STEPS_PER_OCTAVE)   // 1/4 pixel
+#define DISTANCE_LIGHT (DISTANCE_ONE_PIXEL + 3 * DISTANCE_STEPS_PER_OCTAVE)  // 8 pixels
+
+// Set to 1 to anti-alias the final pass, which needs SMOOTH_COLOUR.  Pixels whose
+// value differs from a neighbour by more than ANTI_ALIAS_THRESHOLD, or that are
+// inside the set next to one that isn't, are sampled 4 more times a quarter of a
+// pixel diagonally from the centre, and drawn with the average colour.
+#define ANTI_ALIAS 0
+#define ANTI_ALIAS_THRESHOLD 8
+#define ANTI_ALIAS_ROWS 8  // Rows the cores can get ahead of the display
+
 static MirroredDVDisplay display(FRAME_WIDTH, FRAME_HEIGHT);
+#if SMOOTH_COLOUR
+static PicoGraphics_PenDV_RGB555 graphics(FRAME_WIDTH, FRAME_HEIGHT, display);
+#define DISPLAY_MODE DVDisplay::MODE_RGB555
+#else
 static PicoGraphics_PenDV_P5 graphics(FRAME_WIDTH, FRAME_HEIGHT, display);
+#define DISPLAY_MODE DVDisplay::MODE_PALETTE
+#endif
 
 static FractalBuffer fractal;
 
+// Row of frame_iters shown on each line of the screen
+static int16_t line_rows[FRAME_HEIGHT];
+
+// A pixel from the previous frame is reused if its position is within
+// 1/REUSE_TOLERANCE of a pixel of the new view.  This must be more than 2, so that
+// no two new pixels can reuse the same old pixel, which the in place remap relies on.
+#define REUSE_TOLERANCE 4
+static uint32_t reused_pixels = 0;
+
+// max_iter and iter_offset that frame_iters was computed with
+static uint16_t frame_max_iter;
+static uint16_t frame_iter_offset;
+
+// Set to 1 to adjust max_iter and iter_offset after each frame from its statistics.
+// max_iter is raised when many pixels escape late, as more of the boundary would
+// show with more iterations, and lowered when none escape in the top half of the
+// range but some don't escape at all, as those iterations are wasted.  It isn't
+// raised while frames take longer than FRAME_BUDGET_US, and is lowered if they
+// take twice that.  iter_offset follows the lowest escape count in steps of 31,
+// which keeps the colours the same.
+#define AUTO_ITER 1
+#define MIN_MAX_ITER 32
+#define MAX_MAX_ITER PERTURB_MAX_ITER
+#define FRAME_BUDGET_US 250000
+
+// max_iter is raised when more than 1 in LATE_ESCAPE_RATIO escaped pixels escape late.
+// Distance estimation shows the boundary well with fewer iterations, so allows more.
+#if DISTANCE_ESTIMATE
+#define LATE_ESCAPE_RATIO 50
+#else
+#define LATE_ESCAPE_RATIO 200
+#endif
+
+// Check for points that settle into a cycle, CYCLE_CHECK_FIXED or CYCLE_CHECK_BRENT.
+// The fixed check saves more iterations with the default max_iter, see the README.
+#define CYCLE_CHECK CYCLE_CHECK_FIXED
+
+// Set to 1 to render in tiles, filling areas with a uniform border without computing
+// them (Mariani-Silver), or 0 to compute every pixel row by row.
+#define USE_TILES 1
+#define TILE_WIDTH 48
+#define TILE_HEIGHT 48
+#define TILES_X (FRAME_WIDTH / TILE_WIDTH)
+
+// Set to 1 to use solid guessing for the final pass instead: every other pixel of
+// every other row is computed, and pixels whose computed neighbours agree are
+// copied from them.  This can miss detail thinner than two pixels.
+#define SOLID_GUESS 0
+
+// Set to 1 to draw each frame as passes of 8x8, 4x4 and 2x2 blocks before
+// the full resolution, presenting each pass so changes show sooner.
+#define PROGRESSIVE 1
+#define PROGRESSIVE_FIRST_STEP 8
+static uint32_t first_pass_us = 0;
+static uint32_t anti_alias_samples = 0;  // Extra samples taken by the last frame
+static absolute_time_t first_pass_time;  // When the first pixels of the frame were presented
+
 void on_uart_rx() {
     while (uart_is_readable(uart1)) {
         uint8_t ch = uart_getc(uart1);
@@ -35,91 +186,1200 @@ void on_uart_rx() {
     }
 }
 
+#if DISTANCE_ESTIMATE
+// Brightness for a stored distance, from 0 next to the set to 1 far from it
+static float distance_shade(int d) {
+    return std::min(std::max((d - DISTANCE_DARK) * (1.f / (DISTANCE_LIGHT - DISTANCE_DARK)), 0.f), 1.f);
+}
+#endif
+
+#if SMOOTH_COLOUR
+// Colour for each position along the gradient, 0 is inside the set
+static RGB555 gradient[256];
+static uint16_t smooth_map[256];
+static uint16_t rgb_row_buf[FRAME_WIDTH] alignas(4);
+static uint16_t rgb_reversed_row_buf[FRAME_WIDTH] alignas(4);
+
+static void init_palette() {
+    gradient[0] = 0;
+    for (int i = 1; i < 255; ++i) {
+#if DISTANCE_ESTIMATE
+        gradient[i] = RGB::from_hsv(0.6f, 0.4f, 0.1f + 0.9f * distance_shade(i)).to_rgb555();
+#else
+        gradient[i] = RGB::from_hsv(i * (2.f / 254.f), 1.0f, 0.4f + i * (0.6f / 254.f)).to_rgb555();
+#endif
+    }
+    gradient[FRACTAL_UNKNOWN] = 0;
+
+    // Until there is a histogram the iteration counts are used directly
+    for (int i = 0; i < 256; ++i) {
+        smooth_map[i] = std::min(std::max(i, 1), 254) << 8;
+    }
+}
+
+// Equalise the colours using the histogram of the frame just drawn, so each part
+// of the gradient covers about the same number of pixels in the next frame.
+static void update_smooth_map() {
+    const uint32_t* histogram = fractal.stats.histogram;
+    uint32_t total = 0;
+    for (int i = 1; i < FRACTAL_UNKNOWN; ++i) total += histogram[i];
+    if (total == 0) return;
+
+    uint32_t count = 0;
+    for (int i = 0; i < 256; ++i) {
+        smooth_map[i] = (1 << 8) + (uint32_t)((uint64_t)count * (253 << 8) / total);
+        if (i > 0 && i < FRACTAL_UNKNOWN) count += histogram[i];
+    }
+}
+
+#define PALETTE_CYCLE 0
+#else
+// Set to 1 to animate the colours by rotating the palette.  Each pixel is drawn with
+// the pen for its iteration count modulo 31, so changing the colours only needs the
+// palette to be uploaded, which happens on each flip, and nothing is redrawn.
+// With DISTANCE_ESTIMATE the pens are a fixed ramp of brightness instead.
+#if DISTANCE_ESTIMATE
+#define PALETTE_CYCLE 0
+#else
+#define PALETTE_CYCLE 1
+#endif
+#define PALETTE_CYCLE_US 100000  // Time for the colours to move one pen
+#define PALETTE_HOLD_STEP_MS 20  // Time between flips while holding a frame
+
+static RGB palette_colours[31];
+#if PALETTE_CYCLE
+static int palette_phase = 0;
+#endif
+
+// Pixel value for each iteration count, pen 0 is for inside the set
+static uint8_t iter_pens[256];
+
 static void init_palette() {
     graphics.create_pen(0, 0, 0);
     for (int i = 0; i < 31; ++i) {
-        graphics.create_pen_hsv(i * (1.f / 31.f), 1.0f, 0.5f + (i & 7) * (0.5f / 7.f));
+#if DISTANCE_ESTIMATE
+        palette_colours[i] = RGB::from_hsv(0.6f, 0.4f, 0.1f + i * (0.9f / 30.f));
+#else
+        palette_colours[i] = RGB::from_hsv(i * (1.f / 31.f), 1.0f, 0.5f + (i & 7) * (0.5f / 7.f));
+#endif
+        graphics.create_pen(palette_colours[i].r, palette_colours[i].g, palette_colours[i].b);
+    }
+
+    iter_pens[0] = 0;
+    for (int i = 1; i < 256; ++i) {
+#if DISTANCE_ESTIMATE
+        iter_pens[i] = (1 + (int)(distance_shade(i) * 30.f + 0.5f)) << 2;
+#else
+        iter_pens[i] = (((i - 1) % 31) + 1) << 2;
+#endif
+    }
+}
+#endif
+
+// Rotate the colours to match the time, this takes effect at the next flip
+static void cycle_palette() {
+#if PALETTE_CYCLE
+    const int phase = (time_us_64() / PALETTE_CYCLE_US) % 31;
+    if (phase == palette_phase) return;
+    palette_phase = phase;
+    for (int i = 0; i < 31; ++i) {
+        const RGB& c = palette_colours[(i + phase) % 31];
+        graphics.update_pen(i + 1, c.r, c.g, c.b);
     }
+#endif
+}
+
+static uint8_t row_buf[FRAME_WIDTH] alignas(4);
+#if !SMOOTH_COLOUR
+static uint8_t reversed_row_buf[FRAME_WIDTH] alignas(4);
+#endif
+
+// Position of the pixels along one axis of a view, relative to view_origin
+struct ViewAxis {
+  double first;
+  double inc;
+  int count;
+};
+static ViewAxis view_x, view_y;
+
+// Set to 1 to zoom deep towards deep_zoom_target, switching from fixed_pt_t to 64-bit
+// fixed point and then perturbation as the pixels get smaller, or 0 for the original shallow zoom.
+#define DEEP_ZOOM 1
+
+#if DEEP_ZOOM
+#if DISTANCE_ESTIMATE
+// Perturbation doesn't estimate distances, so stop before it is needed
+#define NUM_ZOOMS 1050
+#else
+#define NUM_ZOOMS 1500
+#endif
+
+// Use perturbation once the pixel spacing is too small for 64-bit fixed point
+#define PERTURB_MAX_INC FIXED64_MIN_INC
+
+// The Misiurewicz point -1.54368901269207636157085597180174798652..., the real
+// root of c^3 + 2c^2 + 2c + 2, which has detail at every scale and is on the
+// real axis so the view stays symmetric.
+static const mp_fixed_t deep_zoom_target = {{0xad1f3d88, 0xc64a0919, 0xfd2c0901, 0xf9d3432f}};
+static const double view_origin = -1.5436890126920764;
+#define AUTO_TARGET 0  // Only applies without DEEP_ZOOM, which always heads for deep_zoom_target
+#else
+// Set to 1 to steer the zoom towards the most detailed part of each frame, see
+// choose_zoom_target, which keeps it interesting for much longer, or 0 for the
+// original fixed path.  This only applies when DEEP_ZOOM is 0.
+#define AUTO_TARGET 1
+#if AUTO_TARGET
+#define NUM_ZOOMS 800       // Stays within 64-bit fixed point
+#define TARGET_TILE 16      // Size of the squares scored for detail
+#define TARGET_INTERVAL 8   // Frames between choosing a new target
+#define TARGET_PAN 0.1      // Fraction of the way to the target moved each frame
+#else
+#define NUM_ZOOMS 100
+#define SHALLOW_ZOOM_Y 0.015f
+#endif
+static const double view_origin = 0.0;
+#endif
+
+// Set to 1 to draw Julia sets instead, for c moving around a circle by one step
+// each frame.  A Julia set is the same rotated by 180 degrees, so only the top half
+// is computed, and the bottom half of the screen shows it rotated.
+#define JULIA 0
+#define JULIA_STEPS 600
+#define JULIA_RADIUS 0.7885
+
+// Set to 1 to explore with the buttons instead of playing the zoom: A zooms in, Y
+// zooms out, and holding X pans, with a tap of X turning the direction it pans in.
+// A move abandons the frame being drawn on both cores, and the pixels it had
+// computed are reused for the new view.
+#define EXPLORE 0
+#define EXPLORE_POLL_MS 10      // Time between reading the buttons while drawing
+#define EXPLORE_REPEAT_MS 150   // Time between moves while a button is held
+#define EXPLORE_TAP_MS 300      // X released sooner than this turns instead of panning
+#define EXPLORE_ZOOM 0.8        // Change in pixel spacing for each step in
+#define EXPLORE_PAN 16          // Each pan step is 1/EXPLORE_PAN of the view width
+
+#if EXPLORE
+static bool poll_navigation();
+#endif
+
+// Only one of each pair of lines mirrored across the real axis is computed, so a view
+// centred on the axis needs half the rows.  There are MAX_AXIS_OFFSET rows more than
+// that, so the axis can be up to that many lines from the centre.  If it is further
+// away every other line is computed, and each row shown on two lines.
+// frame_iters is most of the RAM: half the rows take 172800 bytes of the 264KB, and
+// each extra row another 720, so they are only kept when the view can leave the
+// axis.  The deep zoom and Julia sets stay centred on it unless exploring.  With
+// MAX_AXIS_OFFSET 0 any view that isn't centred on the axis is drawn with every
+// other line, at half the vertical resolution.
+#if (DEEP_ZOOM || JULIA) && !EXPLORE
+#define MAX_AXIS_OFFSET 0
+#else
+#define MAX_AXIS_OFFSET 32
+#endif
+#define FRAME_ROWS (FRAME_HEIGHT / 2 + MAX_AXIS_OFFSET)
+
+// Iteration counts for the rows computed, kept between frames so pixels can be
+// reused when the view changes.
+static uint8_t frame_iters[FRAME_ROWS][FRAME_WIDTH] alignas(4);
+
+static uint32_t zoom_count = 0;
+
+#if AUTO_TARGET
+// Centre of the current view and the point the zoom is heading for
+struct ZoomPath {
+  double centre_x, centre_y;
+  double target_x, target_y;
+};
+static ZoomPath zoom_path;
+#endif
+
+#if JULIA
+static void set_julia_c() {
+  const double angle = zoom_count * (2 * M_PI / JULIA_STEPS);
+  fractal.julia_cx = JULIA_RADIUS * cos(angle);
+  fractal.julia_cy = JULIA_RADIUS * sin(angle);
+}
+
+// Move c on to the next step, every pixel changes so nothing is reused
+static void step_julia() {
+  if (++zoom_count == JULIA_STEPS) zoom_count = 0;
+  set_julia_c();
+  init_fractal(&fractal);
+  reused_pixels = 0;
+  memset(frame_iters, FRACTAL_UNKNOWN, sizeof(frame_iters));
+}
+#endif
+
+static void set_view_from_fractal() {
+  if (fractal.precision_used == PRECISION_FIXED32) {
+    // The view is rounded to fixed_pt_t, which is significant for the spacing
+    view_x.first = fractal.iminx * (1.0 / (1 << 26)) - view_origin;
+    view_x.inc = fractal.incx * (1.0 / (1 << 26));
+    view_y.first = fractal.iminy * (1.0 / (1 << 26));
+    view_y.inc = fractal.incy * (1.0 / (1 << 26));
+  }
+  else {
+    view_x.first = fractal.minx - view_origin;
+    view_x.inc = fractal.incxd;
+    view_y.first = fractal.miny;
+    view_y.inc = fractal.incyd;
+  }
+  view_x.count = fractal.cols;
+  view_y.count = fractal.rows;
+}
+
+// Rows computed for a view.  Lines i and j are mirror images when i + j == sum,
+// and lines first to first + rows - 1 are computed as rows 0 to rows - 1.  If sum
+// is negative nothing is mirrored, and every other line is computed instead.
+struct RowPlan {
+  int16_t first;
+  int16_t rows;
+  int16_t sum;
+};
+
+// Set line_rows for a plan and pass them to the display
+static void set_line_rows(const RowPlan& plan) {
+  for (int i = 0; i < FRAME_HEIGHT; ++i) {
+    int row = (plan.sum < 0) ? i / 2 : i - plan.first;
+    if (plan.sum >= 0 && (row < 0 || row >= plan.rows)) row = plan.sum - i - plan.first;
+    line_rows[i] = row;
+  }
+  display.set_line_rows(line_rows);
+}
+
+static RowPlan row_plan;
+
+// Set the rows to compute for a view with its centre line at centre_y and lines
+// inc_y apart, setting row_plan, line_rows and fractal.rows, miny and maxy.
+// The view is moved by up to half a line so that the sum of the lines mirrored
+// across the axis is a whole number.  The lines that have no partner, or come
+// first of a pair, are contiguous, so they are computed as one block of rows and
+// the rest of the lines show their partner's row.
+static void set_view_rows(double centre_y, double inc_y) {
+  const int h = FRAME_HEIGHT;
+  const int sum = (int)std::min(std::max(floor((h - 1) - 2 * centre_y / inc_y + 0.5), -1.0), 2.0 * h);
+  int first = 0, rows = h;
+  if (sum >= h - 1 && sum <= 2 * (h - 1)) rows = sum / 2 + 1;
+  else if (sum >= 0 && sum < h - 1) {
+    first = (sum + 1) / 2;
+    rows = h - first;
+  }
+
+  if (rows <= FRAME_ROWS) {
+    centre_y = ((h - 1) - sum) * inc_y * 0.5;
+    row_plan = { (int16_t)first, (int16_t)rows, (int16_t)sum };
+    fractal.miny = centre_y + (first - (h - 1) * 0.5) * inc_y;
+    fractal.maxy = fractal.miny + (rows - 1) * inc_y;
+  }
+  else {
+    // The axis is too far from the centre, compute half the lines
+    rows = h / 2;
+    row_plan = { 0, (int16_t)rows, -1 };
+    fractal.miny = centre_y - (h / 2 - 1) * inc_y;
+    fractal.maxy = fractal.miny + (rows - 1) * 2 * inc_y;
+  }
+  fractal.rows = rows;
+  set_line_rows(row_plan);
 }
 
 static void init_mandel() {
-  fractal.rows = FRAME_HEIGHT / 2;
   fractal.cols = FRAME_WIDTH;
   fractal.max_iter = 55;
   fractal.iter_offset = 0;
+#if JULIA
+  // Centred on 0 so that rotating the top half gives the bottom half
+  fractal.minx = -1.8;
+  fractal.maxx = 1.8;
+  set_view_rows(0.0, 3.84 / (FRAME_HEIGHT - 1));
+  fractal.julia = true;
+  set_julia_c();
+#else
   fractal.minx = -2.25f;
   fractal.maxx = 0.75f;
-  fractal.miny = -1.6f;
-  fractal.maxy = 0.f - (1.6f / FRAME_HEIGHT); // Half a row
-  fractal.use_cycle_check = true;
+  set_view_rows(0.0, 3.2 / (FRAME_HEIGHT - 1));
+#endif
+#if AUTO_TARGET
+  zoom_path = { -0.75, 0.0, -0.75, 0.0 };
+#endif
+  fractal.cycle_check = CYCLE_CHECK;
+  fractal.use_bulb_check = true;
+  fractal.precision = PRECISION_AUTO;
+  fractal.distance_estimate = DISTANCE_ESTIMATE;
+#if SMOOTH_COLOUR
+  fractal.smooth_map = smooth_map;
+#endif
   init_fractal(&fractal);
+  set_view_from_fractal();
 }
 
-#define NUM_ZOOMS 100
-static uint32_t zoom_count = 0;
+// Julia sets change every pixel each frame, so nothing is reused for them
+#if !JULIA
+// For each pixel along one axis of the new view, find the pixel of the old view
+// within tolerance of it, or -1 if there isn't one.
+static void build_reuse_map(int16_t* map, const ViewAxis& new_view, const ViewAxis& old_view)
+{
+  const double start = (new_view.first - old_view.first) / old_view.inc;
+  const double ratio = new_view.inc / old_view.inc;
+  const double tolerance = std::min(ratio, 1.0) / REUSE_TOLERANCE;
+  for (int i = 0; i < new_view.count; ++i) {
+    const double pos = start + i * ratio;
+    const int j = (int)floor(pos + 0.5);
+    if (j < 0 || j >= old_view.count || fabs(pos - j) > tolerance) map[i] = -1;
+    else map[i] = j;
+  }
+}
+
+static int16_t reuse_col_map[FRAME_WIDTH];
+static int16_t reuse_row_map[FRAME_ROWS];
+
+// Value of each reused pixel with the new max_iter and iter_offset
+static uint8_t reuse_values[256];
+
+static void reuse_row(int y, uint8_t* tmp) {
+  const uint8_t* old_row = frame_iters[reuse_row_map[y]];
+  for (int x = 0; x < FRAME_WIDTH; ++x) {
+    const int old_x = reuse_col_map[x];
+    if (old_x >= 0) {
+      tmp[x] = reuse_values[old_row[old_x]];
+      if (tmp[x] != FRACTAL_UNKNOWN) ++reused_pixels;
+    }
+    else tmp[x] = FRACTAL_UNKNOWN;
+  }
+  memcpy(frame_iters[y], tmp, FRAME_WIDTH);
+}
+
+// Work out what each value of the previous frame becomes with the current
+// max_iter and iter_offset, or FRACTAL_UNKNOWN if that can't be known.
+// Distances also depend on the change in pixel spacing from prev_x.
+#if DISTANCE_ESTIMATE
+static void build_reuse_values(const ViewAxis& prev_x) {
+#else
+static void build_reuse_values() {
+#endif
+  const int old_max = frame_max_iter;
+  const int new_max = fractal.max_iter;
+#if DISTANCE_ESTIMATE
+  // Distances are relative to the pixel spacing, so go up as the view zooms in.
+  // They are moved by whole steps, carrying the remainder on to the next frame.
+  static double shift_remainder = 0;
+  const double exact_shift = DISTANCE_STEPS_PER_OCTAVE * log2(prev_x.inc / view_x.inc) + shift_remainder;
+  const int shift = (int)floor(exact_shift + 0.5);
+  shift_remainder = exact_shift - shift;
+#elif !SMOOTH_COLOUR
+  const int old_offset = frame_iter_offset;
+  const int new_offset = fractal.iter_offset;
+#endif
+
+  // Points that didn't escape might with more iterations
+  reuse_values[0] = (new_max > old_max) ? FRACTAL_UNKNOWN : 0;
+  reuse_values[FRACTAL_UNKNOWN] = FRACTAL_UNKNOWN;
+
+  for (int i = 1; i < FRACTAL_UNKNOWN; ++i) {
+#if DISTANCE_ESTIMATE
+    // The clamped values are only kept if they stay clamped
+    if ((i == 1 && shift > 0) || (i == FRACTAL_UNKNOWN - 1 && shift < 0)) reuse_values[i] = FRACTAL_UNKNOWN;
+    else reuse_values[i] = std::min(std::max(i + shift, 1), FRACTAL_UNKNOWN - 1);
+#elif SMOOTH_COLOUR
+    // Gradient positions don't depend on the iteration range
+    reuse_values[i] = i;
+#else
+    // The lowest and highest values are clamped so the count isn't exact,
+    // those are only kept when they would be clamped the same way again.
+    if ((i == 1 && new_offset < old_offset) ||
+        (i == FRACTAL_UNKNOWN - 1 && (new_offset > old_offset || new_max < old_max))) {
+      reuse_values[i] = FRACTAL_UNKNOWN;
+      continue;
+    }
+    const int k = i + old_offset;
+    if (k >= new_max) reuse_values[i] = 0;
+    else reuse_values[i] = std::min(std::max(k - new_offset, 1), FRACTAL_UNKNOWN - 1);
+#endif
+  }
+}
+
+// Remap frame_iters from the previous view to the current one, marking any pixels
+// that can't be reused as unknown.
+// This is done in place.  As the map is increasing and never maps two rows to the
+// same row, rows that read from below are done from the top down, then rows that
+// read from above from the bottom up, so no row is overwritten before it is read.
+static void reuse_previous_frame(const ViewAxis& prev_x, const ViewAxis& prev_y) {
+  const int rows = fractal.rows;
+  build_reuse_map(reuse_col_map, view_x, prev_x);
+  build_reuse_map(reuse_row_map, view_y, prev_y);
+
+  uint8_t* tmp = row_buf;
+  reused_pixels = 0;
+#if DISTANCE_ESTIMATE
+  build_reuse_values(prev_x);
+#else
+  build_reuse_values();
+#endif
+  for (int y = 0; y < rows; ++y) {
+    if (reuse_row_map[y] >= y) reuse_row(y, tmp);
+  }
+  for (int y = rows - 1; y >= 0; --y) {
+    if (reuse_row_map[y] >= 0 && reuse_row_map[y] < y) reuse_row(y, tmp);
+  }
+  for (int y = 0; y < rows; ++y) {
+    if (reuse_row_map[y] < 0) memset(frame_iters[y], FRACTAL_UNKNOWN, FRAME_WIDTH);
+  }
+}
+#endif
+
+#if DEEP_ZOOM && !JULIA
+static PerturbRef perturb_ref;
+
+// Zoom in about deep_zoom_target, starting from the initial view.
+static void set_deep_view() {
+  const double scale = pow(0.974, zoom_count);
+  const double centre_x = (-0.75 - view_origin) * scale;
+  const double inc_x = 3.0 / (FRAME_WIDTH - 1) * scale;
+  const double inc_y = 3.2 / (FRAME_HEIGHT - 1) * scale;
+
+#if !AUTO_ITER
+  // Deeper views need more iterations to show the detail
+  fractal.max_iter = 55 + zoom_count / 16;
+#endif
+
+  if (inc_x > PERTURB_MAX_INC) {
+    fractal.minx = view_origin + centre_x - inc_x * (FRAME_WIDTH - 1) * 0.5;
+    fractal.maxx = fractal.minx + inc_x * (FRAME_WIDTH - 1);
+    set_view_rows(0.0, inc_y);
+    init_fractal(&fractal);
+    set_view_from_fractal();
+  }
+  else {
+    // The reference orbit is for the centre of the view, which is on the axis
+    set_view_rows(0.0, inc_y);
+    init_fractal(&fractal);
+
+    mp_fixed_t cx, cy, offset;
+    mp_from_double(&offset, centre_x);
+    mp_add(&cx, &deep_zoom_target, &offset);
+    mp_from_double(&cy, 0.0);
+    perturb_init(&fractal, &perturb_ref, &cx, &cy, inc_x, inc_y);
+
+    view_x.first = centre_x - inc_x * (FRAME_WIDTH - 1) * 0.5;
+    view_x.inc = inc_x;
+    view_y.first = fractal.miny;
+    view_y.inc = inc_y;
+    view_x.count = FRAME_WIDTH;
+    view_y.count = fractal.rows;
+  }
+}
+#endif
+
+#if AUTO_TARGET && !JULIA
+// Score each TARGET_TILE square of the frame just drawn with fractal_detail_score,
+// and aim for the best one in the middle half of the view, which is at most scale
+// times the size of the initial view.  Ties go to the square nearest the centre.
+static void choose_zoom_target(double scale) {
+  // frame_iters isn't for the current view after playing cached frames
+  if (view_x.count == 0) return;
+
+  const double half_width = 0.75 * scale;
+  const double half_height = 0.8 * scale;
+  const int rows = fractal.rows;
+  int best_score = 0;
+  double best_dist = 0;
+  for (int ty = 0; ty + TARGET_TILE <= rows; ty += TARGET_TILE) {
+    for (int tx = 0; tx + TARGET_TILE <= FRAME_WIDTH; tx += TARGET_TILE) {
+      // Each row is shown on both sides of the axis, so take whichever is nearer
+      const double x = view_x.first + (tx + TARGET_TILE / 2) * view_x.inc;
+      double y = view_y.first + (ty + TARGET_TILE / 2) * view_y.inc;
+      if (fabs(y + zoom_path.centre_y) < fabs(y - zoom_path.centre_y)) y = -y;
+      const double dx = x - zoom_path.centre_x;
+      const double dy = y - zoom_path.centre_y;
+      if (fabs(dx) > half_width || fabs(dy) > half_height) continue;
+
+      const int score = fractal_detail_score(frame_iters[0], FRAME_WIDTH, rows, tx, ty, TARGET_TILE);
+
+      const double dist = dx * dx + dy * dy;
+      if (score > best_score || (score == best_score && score > 0 && dist < best_dist)) {
+        best_score = score;
+        best_dist = dist;
+        zoom_path.target_x = x;
+        zoom_path.target_y = y;
+      }
+    }
+  }
+}
+#endif
+
+#if !JULIA
+static void hold_frame(uint32_t ms);
 
 static void zoom_mandel() {
+  const ViewAxis prev_x = view_x;
+  const ViewAxis prev_y = view_y;
+
   if (++zoom_count == NUM_ZOOMS)
   {
+    hold_frame(2000);
     init_mandel();
     zoom_count = 0;
-    sleep_ms(2000);
+    reuse_previous_frame(prev_x, prev_y);
     return;
   }
 
+#if DEEP_ZOOM
+  set_deep_view();
+#elif AUTO_TARGET
+  // Pan towards the target while zooming in
+  const double scale = pow(0.974, zoom_count);
+  if (zoom_count % TARGET_INTERVAL == 1) choose_zoom_target(scale);
+  zoom_path.centre_x += (zoom_path.target_x - zoom_path.centre_x) * TARGET_PAN;
+  zoom_path.centre_y += (zoom_path.target_y - zoom_path.centre_y) * TARGET_PAN;
+  fractal.minx = zoom_path.centre_x - 1.5 * scale;
+  fractal.maxx = zoom_path.centre_x + 1.5 * scale;
+  set_view_rows(zoom_path.centre_y, 3.2 / (FRAME_HEIGHT - 1) * scale);
+  init_fractal(&fractal);
+  set_view_from_fractal();
+#else
+  // Heading away from the real axis, so that less of the view is mirrored.
+  // The view only depends on zoom_count, so any frame can be computed next.
   float zoomx = -.75f - .7f * ((float)zoom_count / (float)NUM_ZOOMS);
-  float sizex = fractal.maxx - fractal.minx;
-  float sizey = fractal.miny * -2.f;
-  float zoomr = 0.974f * 0.5f;
-  fractal.minx = zoomx - zoomr * sizex;
-  fractal.maxx = zoomx + zoomr * sizex;
-  fractal.miny = -zoomr * sizey;
-  fractal.maxy = 0.f + fractal.miny / FRAME_HEIGHT;
+  float zoomy = SHALLOW_ZOOM_Y * ((float)zoom_count / (float)NUM_ZOOMS);
+  const double scale = pow(0.974, zoom_count);
+  fractal.minx = zoomx - 1.5 * scale;
+  fractal.maxx = zoomx + 1.5 * scale;
+  set_view_rows(zoomy, 3.2 / (FRAME_HEIGHT - 1) * scale);
   init_fractal(&fractal);
+  set_view_from_fractal();
+#endif
+  reuse_previous_frame(prev_x, prev_y);
 }
+#endif
 
-static void display_row(int y, uint8_t* buf) {
+#if SMOOTH_COLOUR
+static void write_span(Point p, uint16_t* buf) {
+    display.write_pixel_span(p, FRAME_WIDTH, buf);
+}
+#else
+static void write_span(Point p, uint8_t* buf) {
+    display.write_palette_pixel_span(p, FRAME_WIDTH, buf);
+}
+#endif
+
+// Write row y of the top half of the frame.  For Julia sets it is also written
+// reversed to the bottom half, for the rotated frame table.
+template<typename T> static void write_row(int y, T* buf, T* reversed_buf) {
+    write_span({0, y}, buf);
+#if JULIA
+    for (int i = 0; i < FRAME_WIDTH; ++i) {
+        reversed_buf[i] = buf[FRAME_WIDTH - 1 - i];
+    }
+    write_span({0, FRAME_HEIGHT - 1 - y}, reversed_buf);
+#endif
+}
+
+// Display row y, step is the width of the blocks being drawn in a coarse pass.
+// If spare_offset isn't negative the row is written there in the PSRAM after the
+// frame instead.
+static void display_row(int y, int step = 1, int32_t spare_offset = -1) {
+    const uint8_t* iters = frame_iters[y];
+#if SMOOTH_COLOUR
+    for (int i = 0; i < FRAME_WIDTH; ++i)
+    {
+        rgb_row_buf[i] = gradient[iters[i & ~(step - 1)]];
+    }
+
+    if (spare_offset >= 0) write_span(display.spare_point(spare_offset, sizeof(uint16_t)), rgb_row_buf);
+    else write_row(y, rgb_row_buf, rgb_reversed_row_buf);
+#else
     for (int i = 0; i < FRAME_WIDTH; ++i)
     {
-        uint8_t col = buf[i];
-        if (col > 46) col -= 23;
-        else if (col > 31) col -= 31;
-        buf[i] = col << 2;
+        row_buf[i] = iter_pens[iters[i & ~(step - 1)]];
     }
 
-    display.write_palette_pixel_span({0, y}, FRAME_WIDTH, buf);
+    if (spare_offset >= 0) write_span(display.spare_point(spare_offset, sizeof(uint8_t)), row_buf);
+    else write_row(y, row_buf, reversed_row_buf);
+#endif
 }
 
-static uint8_t row_buf_core1[FRAME_WIDTH];
+// Tiles in the bottom row are cut short when the rows aren't a whole number of tiles
+static void draw_tile(int tile) {
+    const int y = (tile / TILES_X) * TILE_HEIGHT;
+    generate_rect(&fractal, &frame_iters[0][0], FRAME_WIDTH,
+                  (tile % TILES_X) * TILE_WIDTH, y, TILE_WIDTH, std::min(TILE_HEIGHT, fractal.rows - y));
+}
+
+// Work is shared between the cores as a batch of jobs: each core claims the next
+// job from a counter until there are none left, so neither core waits for the
+// other until the end of the batch.
+enum JobType {
+    JOB_ROW,            // Compute every step-th pixel of row job * step
+    JOB_TILE,           // Compute a tile
+    JOB_GUESS_ROW,      // Solid guess row job * 2 from every other pixel
+    JOB_GUESS_BETWEEN,  // Solid guess row job * 2 + 1 from the rows either side
+    JOB_ANTI_ALIAS,     // Anti-alias row job into anti_alias_rows
+};
+static JobType job_type;
+static int job_step;
+static int num_jobs;
+static volatile int next_job;
+static volatile bool job_done[FRAME_ROWS];
+static spin_lock_t* job_lock;
+
+static int claim_job() {
+    uint32_t save = spin_lock_blocking(job_lock);
+    int job = -1;
+    if (next_job < num_jobs) job = next_job++;
+    spin_unlock(job_lock, save);
+    return job;
+}
+
+static void run_jobs(bool display_as_done);
+
 void core1_main() {
     mandel_init();
     while (true) {
-        int y = multicore_fifo_pop_blocking();
-        generate_one_line(&fractal, row_buf_core1, y);
-        multicore_fifo_push_blocking(y);
+        multicore_fifo_pop_blocking();
+        run_jobs(false);
+        multicore_fifo_push_blocking(0);
+    }
+}
+
+static bool row_ready(int y) {
+    if (job_type == JOB_ROW) return job_done[y / job_step];
+    if (job_type == JOB_GUESS_ROW) return job_done[y / 2];
+    if (job_type == JOB_GUESS_BETWEEN) return (y & 1) == 0 || job_done[y / 2];
+    if (job_type == JOB_ANTI_ALIAS) return job_done[y];
+
+    const int first_tile = (y / TILE_HEIGHT) * TILES_X;
+    for (int tile = first_tile; tile < first_tile + TILES_X; ++tile) {
+        if (!job_done[tile]) return false;
+    }
+    return true;
+}
+
+#if ANTI_ALIAS
+#if !SMOOTH_COLOUR
+#error "ANTI_ALIAS averages colours, so needs SMOOTH_COLOUR"
+#endif
+
+// Anti-aliased rows waiting to be displayed, row y is in y % ANTI_ALIAS_ROWS
+static uint16_t anti_alias_rows[ANTI_ALIAS_ROWS][FRAME_WIDTH] alignas(4);
+static uint32_t core_anti_alias_samples[NUM_CORES];
+
+static inline bool needs_anti_alias(int a, int b) {
+    return (a == 0) != (b == 0) || abs(a - b) > ANTI_ALIAS_THRESHOLD;
+}
+#endif
+
+// Display rows from next_display_row onwards that have been completed
+static volatile int next_display_row;
+static void display_completed_rows() {
+    // Rows finished after the frame was abandoned may be incomplete
+    if (fractal.done) return;
+    while (next_display_row < fractal.rows && row_ready(next_display_row)) {
+#if ANTI_ALIAS
+        if (job_type == JOB_ANTI_ALIAS) {
+            write_row(next_display_row, anti_alias_rows[next_display_row % ANTI_ALIAS_ROWS], rgb_reversed_row_buf);
+            ++next_display_row;
+            continue;
+        }
+#endif
+        display_row(next_display_row++);
+    }
+}
+
+#if ANTI_ALIAS
+// Compute row y of the final frame into anti_alias_rows, once the row that was
+// there has been displayed.
+static void anti_alias_row(int y) {
+    while (y >= next_display_row + ANTI_ALIAS_ROWS && !fractal.done) {
+        if (get_core_num() == 0) display_completed_rows();
+    }
+
+    const uint8_t* iters = frame_iters[y];
+    const uint8_t* above = frame_iters[std::max(y - 1, 0)];
+    const uint8_t* below = frame_iters[std::min(y + 1, fractal.rows - 1)];
+    uint16_t* out = anti_alias_rows[y % ANTI_ALIAS_ROWS];
+    uint32_t samples = 0;
+    for (int x = 0; x < FRAME_WIDTH && !fractal.done; ++x) {
+        const int k = iters[x];
+        if (!needs_anti_alias(k, iters[std::max(x - 1, 0)]) && !needs_anti_alias(k, iters[std::min(x + 1, FRAME_WIDTH - 1)]) &&
+            !needs_anti_alias(k, above[x]) && !needs_anti_alias(k, below[x])) {
+            out[x] = gradient[k];
+            continue;
+        }
+
+        // Average the 5 samples, 5 bits for each of red, green and blue
+        uint32_t r = 0, g = 0, b = 0;
+        for (int i = 0; i < 5; ++i) {
+            uint8_t sample = k;
+            if (i < 4) generate_subpixel(&fractal, 4 * x + ((i & 1) ? 1 : -1), 4 * y + ((i & 2) ? 1 : -1), &sample);
+            const RGB555 c = gradient[sample];
+            r += (c >> 10) & 0x1f;
+            g += (c >> 5) & 0x1f;
+            b += c & 0x1f;
+        }
+        out[x] = ((r / 5) << 10) | ((g / 5) << 5) | (b / 5);
+        samples += 4;
     }
+    core_anti_alias_samples[get_core_num()] += samples;
 }
+#endif
 
-static uint8_t row_buf[FRAME_WIDTH];
-static void draw_two_rows(int y) {
-    multicore_fifo_push_blocking(y+1);
-    generate_one_line(&fractal, row_buf, y);
+static void run_jobs(bool display_as_done) {
+    int job;
+    while ((job = claim_job()) >= 0) {
+        if (job_type == JOB_TILE) draw_tile(job);
+        else if (job_type == JOB_GUESS_ROW) guess_missing_in_line(&fractal, frame_iters[job * 2], job * 2);
+        else if (job_type == JOB_GUESS_BETWEEN) {
+            const int y = job * 2 + 1;
+            guess_line_between(&fractal, frame_iters[y], frame_iters[y - 1],
+                               (y + 1 < fractal.rows) ? frame_iters[y + 1] : nullptr, y);
+        }
+#if ANTI_ALIAS
+        else if (job_type == JOB_ANTI_ALIAS) anti_alias_row(job);
+#endif
+        else {
+            int y = job * job_step;
+            generate_missing_in_line(&fractal, frame_iters[y], y, job_step);
+        }
+        job_done[job] = true;
 
-    display_row(y, row_buf);
+        if (display_as_done) display_completed_rows();
+#if EXPLORE
+        if (get_core_num() == 0 && poll_navigation()) fractal.done = true;
+#endif
+    }
+}
 
+// Run a batch of jobs on both cores.  If display_as_done is set, core 0 displays
+// each row as soon as it is complete, including while waiting for core 1 to finish.
+static void run_batch(JobType type, int step, bool display_as_done) {
+    job_type = type;
+    job_step = step;
+    const int rows = fractal.rows;
+    switch (type) {
+        case JOB_TILE: num_jobs = TILES_X * ((rows + TILE_HEIGHT - 1) / TILE_HEIGHT); break;
+        case JOB_GUESS_ROW: num_jobs = (rows + 1) / 2; break;
+        case JOB_GUESS_BETWEEN: num_jobs = rows / 2; break;
+        case JOB_ANTI_ALIAS: num_jobs = rows; break;
+        default: num_jobs = (rows + step - 1) / step; break;
+    }
+    for (int i = 0; i < num_jobs; ++i) job_done[i] = false;
+    next_job = 0;
+    next_display_row = 0;
+
+    multicore_fifo_push_blocking(0);
+    run_jobs(display_as_done);
+    while (!multicore_fifo_rvalid()) {
+        if (display_as_done) display_completed_rows();
+#if EXPLORE
+        if (poll_navigation()) fractal.done = true;
+#endif
+    }
     multicore_fifo_pop_blocking();
-    display_row(y+1, row_buf_core1);
+    if (display_as_done) display_completed_rows();
 }
 
-void draw_mandel() {
+#if PROGRESSIVE
+// Compute and present a coarse pass, where only every step-th pixel of every
+// step-th row is computed, and each is shown as a step x step block.
+// Pixels known from earlier passes or the previous frame aren't computed again.
+static void draw_coarse_pass(int step) {
+    run_batch(JOB_ROW, step, false);
+    if (fractal.done) return;
+
     display.wait_for_flip();
-    for (int y = 0; y < FRAME_HEIGHT / 2; y += 2)
-    {
-        draw_two_rows(y);
+    for (int y = 0; y < fractal.rows; y += step) {
+        display_row(y, step);
+    }
+    display.set_line_repeat(step);
+    cycle_palette();
+    display.flip_async();
+}
+#endif
+
+// Compute the frame, and unless show is false draw and present it.
+// If fractal.done is set part way through, the frame is left unfinished.
+void draw_mandel(bool show = true) {
+    frame_max_iter = fractal.max_iter;
+    frame_iter_offset = fractal.iter_offset;
+
+#if PROGRESSIVE
+    absolute_time_t start_time = get_absolute_time();
+    for (int step = PROGRESSIVE_FIRST_STEP; show && step > 1; step >>= 1) {
+        draw_coarse_pass(step);
+        if (fractal.done) return;
+        if (step == PROGRESSIVE_FIRST_STEP) {
+            first_pass_time = get_absolute_time();
+            first_pass_us = absolute_time_diff_us(start_time, first_pass_time);
+        }
+    }
+#endif
+
+    if (show) {
+        display.wait_for_flip();
+        display.set_line_repeat(1);
+    }
+    // With ANTI_ALIAS the rows are displayed by the anti-aliasing pass instead
+    const bool display_as_done = show && !ANTI_ALIAS;
+#if SOLID_GUESS
+    // The rows between are only guessed once the rows either side are complete
+    run_batch(JOB_GUESS_ROW, 2, false);
+    run_batch(JOB_GUESS_BETWEEN, 2, display_as_done);
+#else
+    run_batch(USE_TILES ? JOB_TILE : JOB_ROW, 1, display_as_done);
+#endif
+    if (fractal.done) return;
+
+    // The extra samples aren't included in the statistics
+    fractal_merge_stats(&fractal);
+#if ANTI_ALIAS
+    anti_alias_samples = 0;
+    if (show) {
+        for (int i = 0; i < NUM_CORES; ++i) core_anti_alias_samples[i] = 0;
+        run_batch(JOB_ANTI_ALIAS, 1, true);
+        if (fractal.done) return;
+        anti_alias_samples = core_anti_alias_samples[0] + core_anti_alias_samples[1];
+    }
+#endif
+    if (show) {
+        cycle_palette();
+        display.flip_async();
+#if !PROGRESSIVE
+        first_pass_time = get_absolute_time();
+#endif
+    }
+
+#if SMOOTH_COLOUR
+    update_smooth_map();
+#endif
+}
+
+#if PALETTE_CYCLE && !JULIA
+// Draw the current frame to the other bank as well, so that flipping keeps showing it
+static void draw_frame_to_back() {
+    display.wait_for_flip();
+    display.set_line_repeat(1);
+    for (int y = 0; y < fractal.rows; ++y) {
+        display_row(y);
+    }
+}
+#endif
+
+#if !JULIA
+// Keep showing the current frame for ms milliseconds.  With PALETTE_CYCLE the frame
+// is drawn to the other bank as well, and then flipped repeatedly to animate the colours.
+static void hold_frame(uint32_t ms) {
+#if PALETTE_CYCLE
+    absolute_time_t end_time = make_timeout_time_ms(ms);
+    draw_frame_to_back();
+    while (!time_reached(end_time)) {
+        cycle_palette();
+        display.flip();
+        sleep_ms(PALETTE_HOLD_STEP_MS);
+    }
+#else
+    sleep_ms(ms);
+#endif
+}
+#endif
+
+// Set to 1 to keep each frame of the zoom in the PSRAM after the frame, in both
+// banks, as it is computed.  When the zoom gets back to the start the cached frames
+// are played back one per flip, only rewriting the frame table, and computing
+// carries on from the first frame that isn't cached.  PSRAM holds about 40 frames,
+// or 20 with SMOOTH_COLOUR.  With ZOOM_CACHE_PRERENDER the frames that fit are
+// computed before any but the first is shown.
+#define ZOOM_CACHE 0
+#define ZOOM_CACHE_PRERENDER 0
+#define ZOOM_CACHE_MAX_FRAMES 64
+
+#if ZOOM_CACHE
+#if JULIA
+#error "The zoom cache doesn't support the reversed rows of Julia sets"
+#endif
+
+#if SMOOTH_COLOUR
+#define CACHE_ROW_BYTES (FRAME_WIDTH * 2)
+#else
+#define CACHE_ROW_BYTES FRAME_WIDTH
+#endif
+
+struct CachedFrame {
+  uint32_t offset;  // Of row 0 in the space after the frame
+  RowPlan plan;
+  uint16_t max_iter;
+  uint16_t iter_offset;
+#if AUTO_TARGET
+  ZoomPath path;
+#endif
+};
+static CachedFrame cached_frames[ZOOM_CACHE_MAX_FRAMES];
+static uint32_t num_cached_frames = 0;
+static uint32_t cache_end = 0;
+static bool playing_cache = false;
+
+// Add the frame just computed to the cache if it is the next one and there is room.
+// The rows are written to the back bank, along with the frame itself if show is
+// set, and after a flip to the other bank.
+static void cache_frame(bool show) {
+  const uint32_t bytes = fractal.rows * CACHE_ROW_BYTES;
+  if (zoom_count != num_cached_frames || num_cached_frames == ZOOM_CACHE_MAX_FRAMES ||
+      cache_end + bytes > display.spare_bytes()) return;
+
+  for (int bank = 0; bank < 2; ++bank) {
+    display.wait_for_flip();
+    for (int y = 0; y < fractal.rows; ++y) {
+      display_row(y, 1, cache_end + y * CACHE_ROW_BYTES);
+      if (show && bank == 0) display_row(y);
     }
+    if (show && bank == 0) display.set_line_repeat(1);
+    cycle_palette();
     display.flip_async();
+  }
+#if AUTO_TARGET
+  cached_frames[num_cached_frames] = { cache_end, row_plan, frame_max_iter, frame_iter_offset, zoom_path };
+#else
+  cached_frames[num_cached_frames] = { cache_end, row_plan, frame_max_iter, frame_iter_offset };
+#endif
+  ++num_cached_frames;
+  cache_end += bytes;
+}
+
+// Present cached frame n by pointing the frame table at its rows
+static void show_cached_frame(uint32_t n) {
+  display.wait_for_flip();
+  set_line_rows(cached_frames[n].plan);
+  display.show_spare_rows(cached_frames[n].offset, CACHE_ROW_BYTES);
+  display.set_line_repeat(1);
+  cycle_palette();
+  display.flip_async();
+}
+
+// Move on to the next frame of the zoom from the cache, returning false when it
+// isn't cached and needs to be computed.
+static bool play_cached_frame() {
+  static uint32_t played = 0;
+  static absolute_time_t play_start_time;
+
+  const uint32_t next = (zoom_count + 1 == NUM_ZOOMS) ? 0 : zoom_count + 1;
+  if (next >= num_cached_frames) {
+    if (playing_cache) {
+      printf("Played %d cached frames in %.2fms\n", (int)played, absolute_time_diff_us(play_start_time, get_absolute_time()) * 0.001f);
+
+      // frame_iters isn't for the frame shown, so nothing can be reused
+      playing_cache = false;
+      display.show_frame_rows();
+      view_x.count = view_y.count = 0;
+      fractal.max_iter = cached_frames[zoom_count].max_iter;
+      fractal.iter_offset = cached_frames[zoom_count].iter_offset;
+#if AUTO_TARGET
+      zoom_path = cached_frames[zoom_count].path;
+#endif
+    }
+    return false;
+  }
+
+  if (next == 0) {
+    if (playing_cache) {
+#if PALETTE_CYCLE
+      absolute_time_t end_time = make_timeout_time_ms(2000);
+      while (!time_reached(end_time)) {
+        show_cached_frame(zoom_count);
+        sleep_ms(PALETTE_HOLD_STEP_MS);
+      }
+#else
+      sleep_ms(2000);
+#endif
+    }
+    else hold_frame(2000);
+  }
+  if (!playing_cache) {
+    played = 0;
+    play_start_time = get_absolute_time();
+  }
+
+  zoom_count = next;
+  show_cached_frame(next);
+  playing_cache = true;
+  ++played;
+  return true;
+}
+#endif
+
+#if AUTO_ITER
+// Set max_iter and iter_offset for the next frame from the statistics of the
+// frame just drawn, which took frame_us.
+static void tune_iterations(uint32_t frame_us) {
+    const FractalStats& stats = fractal.stats;
+    const int max_iter = fractal.max_iter;
+    const int offset = fractal.iter_offset;
+
+    // The histogram is of the escape counts less iter_offset
+    uint32_t escaped = 0, late = 0, top_half = 0;
+    int lowest = 0;
+    for (int i = 1; i < FRACTAL_UNKNOWN; ++i) {
+        const uint32_t count = stats.histogram[i];
+        if (count == 0) continue;
+        if (lowest == 0) lowest = i;
+        escaped += count;
+        if (i + offset > max_iter / 2) top_half += count;
+        if (i + offset > max_iter * 3 / 4) late += count;
+    }
+
+    int new_max_iter = max_iter;
+    if (frame_us > 2 * FRAME_BUDGET_US ||
+        (top_half == 0 && stats.count_inside > 0)) {
+        new_max_iter -= max_iter / 16;
+    }
+    else if (frame_us < FRAME_BUDGET_US && late * LATE_ESCAPE_RATIO > escaped) {
+        new_max_iter += max_iter / 8;
+    }
+    fractal.max_iter = std::min(std::max(new_max_iter, MIN_MAX_ITER), MAX_MAX_ITER);
+
+    // Values of 1 may have been clamped, so the offset is kept low enough for the
+    // lowest count to be at least 2, and reduced if any are 1.
+    if (lowest == 1) {
+        fractal.iter_offset = std::max(offset - 31, 0);
+    }
+    else if (lowest > 1) {
+        const int target = (lowest + offset - 2) / 31 * 31;
+        if (target > offset) fractal.iter_offset = offset + 31;
+        else if (target < offset) fractal.iter_offset = offset - 31;
+    }
+}
+#endif
+
+#if EXPLORE
+#if JULIA || ZOOM_CACHE
+#error "EXPLORE can't be used with JULIA or ZOOM_CACHE"
+#endif
+
+constexpr uint BUTTON_Y = 9;
+
+// The view is given by its centre and the horizontal pixel spacing, which is
+// limited to where 64-bit fixed point runs out, as there is no reference orbit.
+#define EXPLORE_MAX_INC (4.0 / (FRAME_WIDTH - 1))
+#define EXPLORE_MAX_CENTRE 2.5
+static double explore_x = -0.75;
+static double explore_y = 0.0;
+static double explore_inc = 3.0 / (FRAME_WIDTH - 1);
+
+static int pan_direction = 0;  // Right, down, left, up
+static bool x_was_pressed = false;
+static absolute_time_t x_pressed_time;
+static absolute_time_t next_poll_time;
+static absolute_time_t next_move_time;
+static absolute_time_t input_time;  // When the view last moved
+
+// Read the buttons, and move the view if they ask for it, returning whether it
+// moved.  The buttons are read over I2C, so at most every EXPLORE_POLL_MS.
+static bool poll_navigation() {
+    if (!time_reached(next_poll_time)) return false;
+    const absolute_time_t now = get_absolute_time();
+    next_poll_time = delayed_by_ms(now, EXPLORE_POLL_MS);
+
+    const bool a = display.is_button_a_pressed();
+    const bool x = display.is_button_x_pressed();
+    const bool y = gpio_get(BUTTON_Y) == 0;
+
+    // A short press of X turns the pan direction, a long one pans
+    const bool x_held = x && absolute_time_diff_us(x_pressed_time, now) >= EXPLORE_TAP_MS * 1000;
+    if (x && !x_was_pressed) x_pressed_time = now;
+    else if (!x && x_was_pressed && absolute_time_diff_us(x_pressed_time, now) < EXPLORE_TAP_MS * 1000) {
+        pan_direction = (pan_direction + 1) & 3;
+        static const char* const names[] = { "right", "down", "left", "up" };
+        printf("Panning %s\n", names[pan_direction]);
+    }
+    x_was_pressed = x;
+
+    if (!time_reached(next_move_time)) return false;
+    if (a && explore_inc * EXPLORE_ZOOM >= FIXED64_MIN_INC) {
+        explore_inc *= EXPLORE_ZOOM;
+    }
+    else if (y && explore_inc < EXPLORE_MAX_INC) {
+        explore_inc /= EXPLORE_ZOOM;
+    }
+    else if (x_held) {
+        static const int8_t dx[] = { 1, 0, -1, 0 };
+        static const int8_t dy[] = { 0, 1, 0, -1 };
+        const double step = explore_inc * FRAME_WIDTH / EXPLORE_PAN;
+        explore_x = std::min(std::max(explore_x + dx[pan_direction] * step, -EXPLORE_MAX_CENTRE), EXPLORE_MAX_CENTRE);
+        explore_y = std::min(std::max(explore_y + dy[pan_direction] * step, -EXPLORE_MAX_CENTRE), EXPLORE_MAX_CENTRE);
+    }
+    else return false;
+
+    input_time = now;
+    next_move_time = delayed_by_ms(now, EXPLORE_REPEAT_MS);
+    return true;
 }
 
+// Set the view from explore_x, explore_y and explore_inc, reusing what has
+// been computed of the previous view, even if it was abandoned.
+static void set_explore_view() {
+    const ViewAxis prev_x = view_x;
+    const ViewAxis prev_y = view_y;
+    const double inc_y = explore_inc * (3.2 / (FRAME_HEIGHT - 1)) / (3.0 / (FRAME_WIDTH - 1));
+
+    fractal.minx = explore_x - explore_inc * (FRAME_WIDTH - 1) * 0.5;
+    fractal.maxx = fractal.minx + explore_inc * (FRAME_WIDTH - 1);
+    set_view_rows(explore_y, inc_y);
+    init_fractal(&fractal);
+    set_view_from_fractal();
+    reuse_previous_frame(prev_x, prev_y);
+}
+
+// Draw the view each time it moves.  A move while drawing abandons the frame on
+// both cores and starts on the new view straight away, and the time from the
+// move to the first pixels of the new view being shown is reported.
+static void explore() {
+    gpio_init(BUTTON_Y);
+    gpio_set_dir(BUTTON_Y, GPIO_IN);
+    gpio_pull_up(BUTTON_Y);
+
+    // The initial view has already been drawn, unless it was abandoned
+    bool moved = fractal.done;
+    while (true) {
+        if (!moved) {
+#if PALETTE_CYCLE
+            draw_frame_to_back();
+#endif
+            while (!poll_navigation()) {
+#if PALETTE_CYCLE
+                cycle_palette();
+                display.flip();
+                sleep_ms(PALETTE_HOLD_STEP_MS);
+#else
+                sleep_ms(EXPLORE_POLL_MS);
+#endif
+            }
+        }
+
+        absolute_time_t start_time = get_absolute_time();
+        set_explore_view();
+        draw_mandel();
+        moved = fractal.done;
+        const uint32_t frame_us = absolute_time_diff_us(start_time, get_absolute_time());
+        const int64_t latency_us = absolute_time_diff_us(start_time, first_pass_time) >= 0 ?
+                                   absolute_time_diff_us(input_time, first_pass_time) : -1;
+
+        if (moved) {
+            printf("Abandoned view after %.2fms", frame_us * 0.001f);
+            if (latency_us >= 0) printf(", first pixels %.2fms after the input", latency_us * 0.001f);
+            printf("\n");
+            continue;
+        }
+        printf("Drawing view at %.17g, %.17g spacing %.3g took %.2fms, first pixels %.2fms after the input, reused %d%% of pixels, computed %d + %d, guessed %d, %d extra samples, %s, max_iter %d offset %d\n",
+               explore_x, explore_y, explore_inc, frame_us * 0.001f, latency_us * 0.001f,
+               (int)(reused_pixels * 100 / (FRAME_WIDTH * fractal.rows)),
+               (int)fractal.core_stats[0].count_computed, (int)fractal.core_stats[1].count_computed,
+               (int)fractal.stats.count_guessed, (int)anti_alias_samples,
+               (fractal.precision_used == PRECISION_FIXED64) ? "64-bit" : "32-bit",
+               fractal.max_iter, fractal.iter_offset);
+#if AUTO_ITER
+        tune_iterations(frame_us);
+#endif
+    }
+}
+#endif
+
 int main() {
   set_sys_clock_khz(250000, true);
 
@@ -138,7 +1398,7 @@ int main() {
   DVDisplay::preinit();
 
   mandel_init();
-  display.init(FRAME_WIDTH, FRAME_HEIGHT, DVDisplay::MODE_PALETTE, FRAME_WIDTH, FRAME_HEIGHT);
+  display.init(FRAME_WIDTH, FRAME_HEIGHT, DISPLAY_MODE, FRAME_WIDTH, FRAME_HEIGHT);
 
     init_palette();
 
@@ -148,40 +1408,94 @@ int main() {
     graphics.set_pen(0);
     graphics.clear();
 
+#if JULIA
+    display.set_rotated(true);
+#endif
+
+    job_lock = spin_lock_init(spin_lock_claim_unused(true));
     multicore_launch_core1(core1_main);
 
     init_mandel();
+    memset(frame_iters, FRACTAL_UNKNOWN, sizeof(frame_iters));
     draw_mandel();
+#if EXPLORE
+    explore();
+#endif
+#if ZOOM_CACHE
+    cache_frame(true);
+#if ZOOM_CACHE_PRERENDER
+    // Fill the cache while the first frame is shown, then play it from the start
+    while (zoom_count + 1 < NUM_ZOOMS && num_cached_frames == zoom_count + 1) {
+        absolute_time_t start_time = get_absolute_time();
+        zoom_mandel();
+        draw_mandel(false);
+        const uint32_t frame_us = absolute_time_diff_us(start_time, get_absolute_time());
+        printf("Computing zoom %d for the cache took %.2fms\n", zoom_count, frame_us * 0.001f);
+#if AUTO_ITER
+        tune_iterations(frame_us);
+#endif
+        cache_frame(false);
+    }
+    zoom_count = 0;
+    playing_cache = true;
+#endif
+#endif
 
     while(true) {
+#if ZOOM_CACHE
+        if (play_cached_frame()) continue;
+#endif
         absolute_time_t start_time = get_absolute_time();
+#if JULIA
+        step_julia();
+#else
         zoom_mandel();
+#endif
         draw_mandel();
-        printf("Drawing zoom %d took %.2fms\n", zoom_count, absolute_time_diff_us(start_time, get_absolute_time()) * 0.001f);
+        const uint32_t frame_us = absolute_time_diff_us(start_time, get_absolute_time());
+        printf("Drawing zoom %d took %.2fms (first pass %.2fms), reused %d%% of pixels, computed %d + %d, guessed %d, %d extra samples, %d inside, %s, max_iter %d offset %d\n", zoom_count,
+               frame_us * 0.001f, first_pass_us * 0.001f,
+               (int)(reused_pixels * 100 / (FRAME_WIDTH * fractal.rows)),
+               (int)fractal.core_stats[0].count_computed, (int)fractal.core_stats[1].count_computed,
+               (int)fractal.stats.count_guessed, (int)anti_alias_samples, (int)fractal.stats.count_inside,
+               fractal.perturb ? "perturbation" : (fractal.precision_used == PRECISION_FIXED64) ? "64-bit" : "32-bit",
+               fractal.max_iter, fractal.iter_offset);
+#if AUTO_ITER
+        tune_iterations(frame_us);
+#endif
+#if ZOOM_CACHE
+        cache_frame(true);
+#endif
     }
 }
 
 void MirroredDVDisplay::set_scroll_idx_for_lines(int idx, int miny, int maxy) 
 {
     // This just ignores the arguments and always sets up the full frame table, 
-    // but with the bottom half of the screen mirroring the top half.
+    // but with lines mirrored across the real axis showing the same row.
     //
-    // That allows us to draw just one half of the fractal and get the mirrored portion for free.
+    // That allows us to draw just the unique rows of the fractal and get the mirrored portion for free.
+    printf("Write header, line type %08x\n", 0x80000000u + ((uint)mode << 27));
+    write_frame_table();
+}
+
+void MirroredDVDisplay::write_frame_table()
+{
     uint32_t buf[8];
     uint addr = 4 * 7;
     uint line_type = 0x80000000u + ((uint)mode << 27);
-    printf("Write header, line type %08x\n", line_type);
-    for (int i = 0; i < display_height/2; i += 8) {
-      for (int j = 0; j < 8; ++j) {
-        buf[j] = line_type + ((uint32_t)h_repeat << 24) + ((i + j) * frame_width * 3) + base_address;
-      }
-      ram.write(addr, buf, 8 * 4);
-      ram.wait_for_finish_blocking();
-      addr += 4 * 8;
+    uint32_t origin = base_address;
+    uint32_t stride = frame_width * 3;
+    if (spare_stride) {
+      origin += frame_height * stride + spare_offset;
+      stride = spare_stride;
     }
-    for (int i = 0; i < display_height/2; i += 8) {
+    for (int i = 0; i < display_height; i += 8) {
       for (int j = 0; j < 8; ++j) {
-        buf[j] = line_type + ((uint32_t)h_repeat << 24) + ((display_height/2 - 1 - (i + j)) * frame_width * 3) + base_address;
+        int row = line_rows[i + j];
+        row -= row % line_repeat;
+        if (rotated && i + j >= display_height / 2) row = frame_height - 1 - row;
+        buf[j] = line_type + ((uint32_t)h_repeat << 24) + (row * stride) + origin;
       }
       ram.write(addr, buf, 8 * 4);
       ram.wait_for_finish_blocking();
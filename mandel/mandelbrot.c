@@ -2,54 +2,29 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <math.h>
 #include "pico/stdlib.h"
 #include "hardware/interp.h"
 
 #include "mandelbrot.h"
+#include "perturb.h"
+#include "fixed_pt.h"
 
 // Cycle checking parameters
 #define MAX_CYCLE_LEN 8          // Must be power of 2
 #define MIN_CYCLE_CHECK_ITER 24  // Must be multiple of max cycle len
 #define CYCLE_TOLERANCE (1<<18)
+#define MAX_CYCLE_WINDOW 1024    // Longest window for the Brent cycle check
+#define BRENT_CYCLE_TOLERANCE (1<<15)  // Smaller as every iteration is compared
 
-// Fixed point with 6 bits to the left of the point.
-// Range [-32,32) with precision 2^-26
-typedef int32_t fixed_pt_t;
+// First window for the Brent cycle check on each core, this is the period found
+// by the last pixel found to be in a cycle, rounded up to a power of 2.
+static uint16_t cycle_window_hint[NUM_CORES];
 
-#define ESCAPE_SQUARE (4<<26)
-
-static inline fixed_pt_t mul(fixed_pt_t a, fixed_pt_t b)
-{
-  int32_t ah = a >> 13;
-  int32_t al = a & 0x1fff;
-  int32_t bh = b >> 13;
-  int32_t bl = b & 0x1fff;
-
-  // Ignore al * bl as contribution to final result is only the carry.
-  fixed_pt_t r = ((ah * bl) + (al * bh)) >> 13;
-  r += ah * bh;
-  return r;
-}
-
-// a * b * 2
-static inline fixed_pt_t mul2(fixed_pt_t a, fixed_pt_t b)
-{
-  int32_t ah = a >> 12;
-  int32_t al = (a & 0xfff) << 1;
-  int32_t bh = b >> 13;
-  int32_t bl = b & 0x1fff;
-
-  fixed_pt_t r = ((ah * bl) + (al * bh)) >> 13;
-  r += ah * bh;
-  return r;
-}
-
-static inline fixed_pt_t square(fixed_pt_t a) {
-  int32_t ah = a >> 13;
-  int32_t al = a & 0x1fff;
-
-  return ((ah * al) >> 12) + (ah * ah);
-}
+// Rectangles with no more than this many interior pixels are computed
+// directly instead of being subdivided further
+#define MIN_SUBDIVIDE_AREA 32
 
 fixed_pt_t make_fixed(int32_t x) {
   return x << 26;
@@ -59,70 +34,152 @@ fixed_pt_t make_fixedf(float x) {
   return (int32_t)(x * (67108864.f));
 }
 
+uint8_t smooth_fraction[256];
+
 void mandel_init()
 {
+  // The smooth iteration count is k + 1 - log2(log2(|z|)), so the fraction to add
+  // to k is 1 - log2(log2(|z|^2) / 2), which is 1 for |z|^2 = 4 and reaches 0 at 16.
+  for (int i = 0; i < 256; ++i) {
+    const float mag = 4.f + (i + 0.5f) * 0.125f;
+    const float frac = 1.f - log2f(log2f(mag) * 0.5f);
+    smooth_fraction[i] = (frac <= 0.f) ? 0 : (frac >= 1.f) ? 255 : (uint8_t)(frac * 256.f);
+  }
+
   interp_config cfg = interp_default_config();
   interp_set_config(interp0, 0, &cfg);
   interp_set_config(interp1, 0, &cfg);
-  interp0->base[0] = 1;
+  interp_set_base(interp0, 0, 1);
+}
+
+static fixed64_t make_fixed64d(double x) {
+  return (int64_t)(x * 288230376151711744.);
 }
 
 void init_fractal(FractalBuffer* f)
 {
   f->done = false;
-  f->min_iter = f->max_iter - 1;
-  f->iminx = make_fixedf(f->minx);
-  f->imaxx = make_fixedf(f->maxx);
-  f->iminy = make_fixedf(f->miny);
-  f->imaxy = make_fixedf(f->maxy);
+  f->incxd = (f->maxx - f->minx) / (f->cols - 1);
+  f->incyd = (f->maxy - f->miny) / (f->rows - 1);
+  f->log2_inc = log2f((float)f->incxd);
+
+  f->precision_used = f->precision;
+  if (f->precision == PRECISION_AUTO) {
+    double inc = (f->incxd < f->incyd) ? f->incxd : f->incyd;
+    f->precision_used = (inc >= FIXED32_MIN_INC(f->max_iter)) ? PRECISION_FIXED32 : PRECISION_FIXED64;
+  }
+
+  f->iminx64 = make_fixed64d(f->minx);
+  f->iminy64 = make_fixed64d(f->miny);
+  f->incx64 = make_fixed64d(f->incxd);
+  f->incy64 = make_fixed64d(f->incyd);
+
+  f->icx64 = make_fixed64d(f->julia_cx);
+  f->icy64 = make_fixed64d(f->julia_cy);
+  f->icx = f->icx64 >> 32;
+  f->icy = f->icy64 >> 32;
+
+  f->iminx = f->iminx64 >> 32;
+  f->imaxx = make_fixed64d(f->maxx) >> 32;
+  f->iminy = f->iminy64 >> 32;
+  f->imaxy = make_fixed64d(f->maxy) >> 32;
   f->incx = (f->imaxx - f->iminx) / (f->cols - 1);
   f->incy = (f->imaxy - f->iminy) / (f->rows - 1);
-  f->count_inside = 0;
+  for (int i = 0; i < NUM_CORES; ++i) {
+    memset(f->core_stats[i].histogram, 0, sizeof(f->core_stats[i].histogram));
+    memset(f->core_stats[i].value_keys, 0, sizeof(f->core_stats[i].value_keys));
+    f->core_stats[i].count_inside = 0;
+    f->core_stats[i].count_computed = 0;
+    f->core_stats[i].count_iterations = 0;
+    f->core_stats[i].count_guessed = 0;
+    f->core_stats[i].min_iter = f->max_iter - 1;
+  }
+  f->perturb = NULL;
 }
 
-static inline void generate_one(FractalBuffer* f, fixed_pt_t x0, fixed_pt_t y0, uint8_t* buffptr)
+void fractal_merge_stats(FractalBuffer* f)
 {
+  f->stats = f->core_stats[0];
+  for (int i = 1; i < NUM_CORES; ++i) {
+    f->stats.count_inside += f->core_stats[i].count_inside;
+    f->stats.count_computed += f->core_stats[i].count_computed;
+    f->stats.count_iterations += f->core_stats[i].count_iterations;
+    f->stats.count_guessed += f->core_stats[i].count_guessed;
+    if (f->stats.min_iter > f->core_stats[i].min_iter) f->stats.min_iter = f->core_stats[i].min_iter;
+    for (int j = 0; j < 256; ++j) f->stats.histogram[j] += f->core_stats[i].histogram[j];
+  }
+}
+
+// Whether the point is in the main cardioid or the period 2 bulb, which would
+// otherwise iterate until max_iter or the cycle check finds them.
+static inline bool in_cardioid_or_bulb(fixed_pt_t x0, fixed_pt_t y0)
+{
+  // Bounding box of both regions, which also keeps the arithmetic below in range
+  if (x0 < -(5 << 24) || x0 > (3 << 23) || y0 > (11 << 22) || y0 < -(11 << 22)) return false;
+
+  // Period 2 bulb: (x + 1)^2 + y^2 < 1/16
+  const fixed_pt_t y_square = square(y0);
+  if (square(x0 + (1 << 26)) + y_square < (1 << 22)) return true;
+
+  // Main cardioid: q(q + x - 1/4) < y^2 / 4, where q = (x - 1/4)^2 + y^2
+  if (x0 < -(3 << 24)) return false;
+  const fixed_pt_t xq = x0 - (1 << 24);
+  const fixed_pt_t q = square(xq) + y_square;
+  return mul(q, q + xq) < (y_square >> 2);
+}
+
+static inline void generate_one(FractalBuffer* f, fixed_pt_t x0, fixed_pt_t y0, fixed_pt_t cx, fixed_pt_t cy, uint8_t* buffptr)
+{
+  if (f->use_bulb_check && !f->julia && in_cardioid_or_bulb(x0, y0)) {
+    set_inside(f, buffptr, 0);
+    return;
+  }
+
   fixed_pt_t x = x0;
   fixed_pt_t y = y0;
+  fixed_pt_t mag = 0;
 
   uint16_t k = 1;
   for (; k < f->max_iter; ++k) {
     fixed_pt_t x_square = square(x);
     fixed_pt_t y_square = square(y);
-    if (x_square + y_square > ESCAPE_SQUARE) break;
+    mag = x_square + y_square;
+    if (mag > ESCAPE_SQUARE) break;
 
-    fixed_pt_t nextx = x_square - y_square + x0;
-    y = mul2(x,y) + y0;
+    fixed_pt_t nextx = x_square - y_square + cx;
+    y = mul2(x,y) + cy;
     x = nextx;
   }
   if (k == f->max_iter) {
-    *buffptr = 0;
-    f->count_inside++;
+    set_inside(f, buffptr, k);
   } else {
-    if (k > f->iter_offset) k -= f->iter_offset;
-    else k = 1;
-    *buffptr = k;
-    if (f->min_iter > k) f->min_iter = k;
+    set_escaped(f, buffptr, k, mag);
   }
 }
 
-static inline void generate_one_cycle_check(FractalBuffer* f, fixed_pt_t x0, fixed_pt_t y0, uint8_t* buffptr)
+static inline void generate_one_cycle_check(FractalBuffer* f, fixed_pt_t x0, fixed_pt_t y0, fixed_pt_t cx, fixed_pt_t cy, uint8_t* buffptr)
 {
+  if (f->use_bulb_check && !f->julia && in_cardioid_or_bulb(x0, y0)) {
+    set_inside(f, buffptr, 0);
+    return;
+  }
+
   fixed_pt_t x = x0;
   fixed_pt_t y = y0;
+  fixed_pt_t mag = 0;
   fixed_pt_t oldx = 0, oldy = 0;
 
-  interp0->accum[0] = 1;
+  interp_set_accumulator(interp0, 0, 1);
   //uint32_t k = 1;
   while (true) {
     fixed_pt_t x_square = square(x);
     fixed_pt_t y_square = square(y);
-    if (x_square + y_square > ESCAPE_SQUARE) break;
+    mag = x_square + y_square;
+    if (mag > ESCAPE_SQUARE) break;
 
-    uint32_t k = interp0->pop[0];
+    uint32_t k = interp_pop_lane_result(interp0, 0);
     if (k == f->max_iter) {
-      *buffptr = 0;
-      f->count_inside++;
+      set_inside(f, buffptr, k);
       return;
     }
     if (k >= MIN_CYCLE_CHECK_ITER) {
@@ -134,37 +191,442 @@ static inline void generate_one_cycle_check(FractalBuffer* f, fixed_pt_t x0, fix
       {
         if ((uint32_t)(x - oldx) < (2*CYCLE_TOLERANCE) && (uint32_t)(y - oldy) < (2*CYCLE_TOLERANCE)) {
           // Found a cycle
-          *buffptr = 0;
-          f->count_inside++;
+          set_inside(f, buffptr, k);
           return;
         }
       }
     }
 
-    fixed_pt_t nextx = x_square - y_square + x0;
-    y = mul2(x,y) + y0;
+    fixed_pt_t nextx = x_square - y_square + cx;
+    y = mul2(x,y) + cy;
+    x = nextx;
+  }
+
+  set_escaped(f, buffptr, interp_get_accumulator(interp0, 0), mag);
+}
+
+// Brent's cycle detection: the point is compared against one saved point, which is
+// replaced at the end of each window, with the windows doubling in length.
+// That finds cycles of any length up to MAX_CYCLE_WINDOW, and as neighbouring
+// pixels tend to have the same period the first window is seeded from the last one found.
+static inline void generate_one_brent(FractalBuffer* f, fixed_pt_t x0, fixed_pt_t y0, fixed_pt_t cx, fixed_pt_t cy, uint8_t* buffptr)
+{
+  if (f->use_bulb_check && !f->julia && in_cardioid_or_bulb(x0, y0)) {
+    set_inside(f, buffptr, 0);
+    return;
+  }
+
+  fixed_pt_t x = x0;
+  fixed_pt_t y = y0;
+  fixed_pt_t mag = 0;
+  fixed_pt_t oldx = 0, oldy = 0;
+  uint16_t* window_hint = &cycle_window_hint[get_core_num()];
+  uint32_t window = *window_hint;
+  uint32_t saved_k = 0;
+  uint32_t next_save = MIN_CYCLE_CHECK_ITER;
+
+  interp_set_accumulator(interp0, 0, 1);
+  while (true) {
+    fixed_pt_t x_square = square(x);
+    fixed_pt_t y_square = square(y);
+    mag = x_square + y_square;
+    if (mag > ESCAPE_SQUARE) break;
+
+    uint32_t k = interp_pop_lane_result(interp0, 0);
+    if (k == f->max_iter) {
+      set_inside(f, buffptr, k);
+      return;
+    }
+    if (saved_k) {
+      if ((uint32_t)(x - oldx) < (2*BRENT_CYCLE_TOLERANCE) && (uint32_t)(y - oldy) < (2*BRENT_CYCLE_TOLERANCE)) {
+        // Found a cycle
+        uint32_t period = 1;
+        while (period < k - saved_k) period <<= 1;
+        *window_hint = period;
+        set_inside(f, buffptr, k);
+        return;
+      }
+    }
+    if (k == next_save) {
+      oldx = x - BRENT_CYCLE_TOLERANCE;
+      oldy = y - BRENT_CYCLE_TOLERANCE;
+      saved_k = k;
+      next_save = k + window;
+      if (window < MAX_CYCLE_WINDOW) window <<= 1;
+    }
+
+    fixed_pt_t nextx = x_square - y_square + cx;
+    y = mul2(x,y) + cy;
+    x = nextx;
+  }
+
+  set_escaped(f, buffptr, interp_get_accumulator(interp0, 0), mag);
+}
+
+// Distance estimation: the derivative dz of z with respect to c, or to the starting
+// z for a Julia set, is iterated alongside z.  It is held scaled by 2^-dz_exp, and
+// halved whenever it reaches DERIVATIVE_LIMIT.  There is no cycle check, as only
+// the escaped pixels show any detail.
+static inline void generate_one_distance(FractalBuffer* f, fixed_pt_t x0, fixed_pt_t y0, fixed_pt_t cx, fixed_pt_t cy, uint8_t* buffptr)
+{
+  if (f->use_bulb_check && !f->julia && in_cardioid_or_bulb(x0, y0)) {
+    set_inside(f, buffptr, 0);
+    return;
+  }
+
+  fixed_pt_t x = x0;
+  fixed_pt_t y = y0;
+  fixed_pt_t mag = 0;
+  fixed_pt_t dx = make_fixed(1);
+  fixed_pt_t dy = 0;
+  fixed_pt_t one = f->julia ? 0 : make_fixed(1);  // The 1 added to dz, also scaled
+  int32_t dz_exp = 0;
+
+  uint16_t k = 1;
+  for (; k < f->max_iter; ++k) {
+    fixed_pt_t x_square = square(x);
+    fixed_pt_t y_square = square(y);
+    mag = x_square + y_square;
+    if (mag > ESCAPE_SQUARE) break;
+
+    // dz = 2 z dz + 1
+    fixed_pt_t nextdx = mul2(x, dx) - mul2(y, dy) + one;
+    dy = mul2(x, dy) + mul2(y, dx);
+    dx = nextdx;
+    while ((dx ^ (dx >> 31)) >= DERIVATIVE_LIMIT || (dy ^ (dy >> 31)) >= DERIVATIVE_LIMIT) {
+      dx >>= 1;
+      dy >>= 1;
+      one >>= 1;
+      ++dz_exp;
+    }
+
+    fixed_pt_t nextx = x_square - y_square + cx;
+    y = mul2(x,y) + cy;
     x = nextx;
   }
+  if (k == f->max_iter) {
+    set_inside(f, buffptr, k);
+  } else {
+    set_distance(f, buffptr, k, distance_log2(ldexpf((float)mag, -26), ldexpf((float)(square(dx) + square(dy)), -26), dz_exp));
+  }
+}
+
+static inline void generate_pixel(FractalBuffer* f, fixed_pt_t x0, fixed_pt_t y0, uint8_t* buffptr)
+{
+  // c is the pixel for the Mandelbrot set, and fixed for a Julia set
+  const fixed_pt_t cx = f->julia ? f->icx : x0;
+  const fixed_pt_t cy = f->julia ? f->icy : y0;
+
+  if (f->distance_estimate) {
+    generate_one_distance(f, x0, y0, cx, cy, buffptr);
+    return;
+  }
+
+  switch (f->cycle_check) {
+    case CYCLE_CHECK_FIXED: generate_one_cycle_check(f, x0, y0, cx, cy, buffptr); break;
+    case CYCLE_CHECK_BRENT: generate_one_brent(f, x0, y0, cx, cy, buffptr); break;
+    default: generate_one(f, x0, y0, cx, cy, buffptr); break;
+  }
+}
+
+// 64-bit fixed point generators, see mandelbrot_kernel.h
+#define KERNEL(name) name##_fixed64
+#define real_t fixed64_t
+#define REAL_SQUARE(a) square64(a)
+#define REAL_MUL2(a, b) (mul64(a, b) << 1)
+#define REAL_ESCAPE ESCAPE_SQUARE64
+#define REAL_TO_FIXED(a) ((fixed_pt_t)((a) >> 32))
+#define REAL_X(f, x) ((f)->iminx64 + (x) * (f)->incx64)
+#define REAL_Y(f, y) ((f)->iminy64 + (y) * (f)->incy64)
+#define REAL_X4(f, x4) ((f)->iminx64 + (((x4) * (f)->incx64) >> 2))
+#define REAL_Y4(f, y4) ((f)->iminy64 + (((y4) * (f)->incy64) >> 2))
+#define REAL_CX(f) ((f)->icx64)
+#define REAL_CY(f) ((f)->icy64)
+#define REAL_TOLERANCE(f) ((f)->incx64 >> 3)
+#define REAL_NEAR(a, b, t) ((uint64_t)((a) - (b) + (t)) < 2 * (uint64_t)(t))
+#define REAL_ONE ((int64_t)1<<58)
+#define REAL_DERIVATIVE_LIMIT ((int64_t)4<<58)
+#define REAL_HALF(a) ((a) >> 1)
+#define REAL_TO_FLOAT(a) ldexpf((float)(a), -58)
+#include "mandelbrot_kernel.h"
+
+#if !PICO_ON_DEVICE
+// Floating point generators, for comparison on the host only
+// as there is no floating point hardware on the RP2040.
+#define KERNEL(name) name##_float
+#define real_t float
+#define REAL_SQUARE(a) ((a) * (a))
+#define REAL_MUL2(a, b) (2.f * (a) * (b))
+#define REAL_ESCAPE 4.f
+#define REAL_TO_FIXED(a) ((a) < 32.f ? (fixed_pt_t)((a) * 67108864.f) : INT32_MAX)
+#define REAL_X(f, x) ((float)((f)->minx + (x) * (f)->incxd))
+#define REAL_Y(f, y) ((float)((f)->miny + (y) * (f)->incyd))
+#define REAL_X4(f, x4) ((float)((f)->minx + (x4) * (f)->incxd * 0.25))
+#define REAL_Y4(f, y4) ((float)((f)->miny + (y4) * (f)->incyd * 0.25))
+#define REAL_CX(f) ((float)(f)->julia_cx)
+#define REAL_CY(f) ((float)(f)->julia_cy)
+#define REAL_TOLERANCE(f) ((float)((f)->incxd / 8))
+#define REAL_NEAR(a, b, t) (fabsf((a) - (b)) < (t))
+#define REAL_ONE 1.f
+#define REAL_DERIVATIVE_LIMIT 4.f
+#define REAL_HALF(a) ((a) * 0.5f)
+#define REAL_TO_FLOAT(a) (a)
+#include "mandelbrot_kernel.h"
+
+#define KERNEL(name) name##_double
+#define real_t double
+#define REAL_SQUARE(a) ((a) * (a))
+#define REAL_MUL2(a, b) (2. * (a) * (b))
+#define REAL_ESCAPE 4.
+#define REAL_TO_FIXED(a) ((a) < 32. ? (fixed_pt_t)((a) * 67108864.) : INT32_MAX)
+#define REAL_X(f, x) ((f)->minx + (x) * (f)->incxd)
+#define REAL_Y(f, y) ((f)->miny + (y) * (f)->incyd)
+#define REAL_X4(f, x4) ((f)->minx + (x4) * (f)->incxd * 0.25)
+#define REAL_Y4(f, y4) ((f)->miny + (y4) * (f)->incyd * 0.25)
+#define REAL_CX(f) ((f)->julia_cx)
+#define REAL_CY(f) ((f)->julia_cy)
+#define REAL_TOLERANCE(f) ((f)->incxd / 8)
+#define REAL_NEAR(a, b, t) (fabs((a) - (b)) < (t))
+#define REAL_ONE 1.
+#define REAL_DERIVATIVE_LIMIT 4.
+#define REAL_HALF(a) ((a) * 0.5)
+#define REAL_TO_FLOAT(a) ((float)(a))
+#include "mandelbrot_kernel.h"
+#endif
+
+// Whether the fast 32-bit fixed point generators that step along the row
+// with the interpolator can be used
+static inline bool use_fixed32(FractalBuffer* f)
+{
+  return !f->perturb && f->precision_used == PRECISION_FIXED32;
+}
+
+// Generate the pixel at column x, row y with whichever method is in use
+static inline void generate_pixel_at(FractalBuffer* f, int16_t x, int16_t y, uint8_t* buffptr)
+{
+  if (f->perturb) {
+    perturb_generate_one(f, x, y, buffptr);
+    return;
+  }
+
+  switch (f->precision_used) {
+    case PRECISION_FIXED64: generate_pixel_fixed64(f, x, y, buffptr); break;
+#if !PICO_ON_DEVICE
+    case PRECISION_FLOAT: generate_pixel_float(f, x, y, buffptr); break;
+    case PRECISION_DOUBLE: generate_pixel_double(f, x, y, buffptr); break;
+#endif
+    default: generate_pixel(f, f->iminx + x * f->incx, f->iminy + y * f->incy, buffptr); break;
+  }
+}
+
+void generate_subpixel(FractalBuffer* f, int16_t x4, int16_t y4, uint8_t* buffptr)
+{
+  if (f->perturb) {
+    perturb_generate_subpixel(f, x4, y4, buffptr);
+    return;
+  }
 
-  uint16_t k = interp0->accum[0];
-  if (k > f->iter_offset) k -= f->iter_offset;
-  else k = 1;
-  *buffptr = k;
-  if (f->min_iter > k) f->min_iter = k;
+  switch (f->precision_used) {
+    case PRECISION_FIXED64: generate_subpixel_fixed64(f, x4, y4, buffptr); break;
+#if !PICO_ON_DEVICE
+    case PRECISION_FLOAT: generate_subpixel_float(f, x4, y4, buffptr); break;
+    case PRECISION_DOUBLE: generate_subpixel_double(f, x4, y4, buffptr); break;
+#endif
+    default: generate_pixel(f, f->iminx + (fixed_pt_t)(((int64_t)x4 * f->incx) >> 2),
+                            f->iminy + (fixed_pt_t)(((int64_t)y4 * f->incy) >> 2), buffptr); break;
+  }
+}
+
+// Start a new line with no hint for the cycle window
+static inline void reset_cycle_window()
+{
+  cycle_window_hint[get_core_num()] = 1;
 }
 
 void generate_one_line(FractalBuffer* f, uint8_t* buf, uint16_t ipos)
 {
   if (f->done) return;
 
+  fractal_core_stats(f)->count_computed += f->cols;
+  reset_cycle_window();
+
+  if (!use_fixed32(f)) {
+    for (int16_t x = 0; x < f->cols; ++x) {
+      generate_pixel_at(f, x, ipos, buf + x);
+    }
+    return;
+  }
+
   fixed_pt_t y0 = f->iminy + ipos * f->incy;
   fixed_pt_t x0 = f->iminx;
   uint8_t* buf_end = buf + f->cols;
-  interp1->base[0] = f->incx;
-  interp1->accum[0] = f->iminx;
+  interp_set_base(interp1, 0, f->incx);
+  interp_set_accumulator(interp1, 0, f->iminx);
 
   while (buf < buf_end) {
-    generate_one_cycle_check(f, x0, y0, buf++);
-    x0 = interp1->pop[0];
+    generate_pixel(f, x0, y0, buf++);
+    x0 = interp_pop_lane_result(interp1, 0);
+  }
+}
+
+void generate_missing_in_line(FractalBuffer* f, uint8_t* buf, uint16_t ipos, uint16_t step)
+{
+  if (f->done) return;
+
+  FractalStats* stats = fractal_core_stats(f);
+  reset_cycle_window();
+
+  // done is checked for each pixel, so that generation can be abandoned mid-row
+  if (!use_fixed32(f)) {
+    for (int16_t x = 0; x < f->cols && !f->done; x += step) {
+      if (buf[x] == FRACTAL_UNKNOWN) {
+        generate_pixel_at(f, x, ipos, buf + x);
+        stats->count_computed++;
+      }
+    }
+    return;
+  }
+
+  fixed_pt_t y0 = f->iminy + ipos * f->incy;
+  fixed_pt_t x0 = f->iminx;
+  uint8_t* buf_end = buf + f->cols;
+  interp_set_base(interp1, 0, f->incx * step);
+  interp_set_accumulator(interp1, 0, f->iminx);
+
+  while (buf < buf_end && !f->done) {
+    if (*buf == FRACTAL_UNKNOWN) {
+      generate_pixel(f, x0, y0, buf);
+      stats->count_computed++;
+    }
+    buf += step;
+    x0 = interp_pop_lane_result(interp1, 0);
+  }
+}
+
+// Set an unknown pixel to k if its neighbours are uniform, otherwise compute it
+static inline void guess_pixel(FractalBuffer* f, FractalStats* stats, uint8_t* buffptr, int16_t x, int16_t y, bool uniform, uint8_t k)
+{
+  if (*buffptr != FRACTAL_UNKNOWN) return;
+  if (uniform && k != FRACTAL_UNKNOWN) {
+    copy_pixel(f, buffptr, k);
+    stats->count_guessed++;
+  }
+  else {
+    generate_pixel_at(f, x, y, buffptr);
+    stats->count_computed++;
+  }
+}
+
+void guess_missing_in_line(FractalBuffer* f, uint8_t* buf, uint16_t ipos)
+{
+  generate_missing_in_line(f, buf, ipos, 2);
+  if (f->done) return;
+
+  FractalStats* stats = fractal_core_stats(f);
+  reset_cycle_window();
+
+  for (int16_t x = 1; x < f->cols && !f->done; x += 2) {
+    const uint8_t k = buf[x - 1];
+    const bool uniform = (x + 1 < f->cols) && buf[x + 1] == k;
+    guess_pixel(f, stats, buf + x, x, ipos, uniform, k);
+  }
+}
+
+void guess_line_between(FractalBuffer* f, uint8_t* buf, const uint8_t* above, const uint8_t* below, uint16_t ipos)
+{
+  if (!below) {
+    generate_missing_in_line(f, buf, ipos, 1);
+    return;
+  }
+  if (f->done) return;
+
+  FractalStats* stats = fractal_core_stats(f);
+  reset_cycle_window();
+
+  const int16_t last = f->cols - 1;
+  for (int16_t x = 0; x <= last && !f->done; ++x) {
+    const uint8_t k = above[x];
+    bool uniform = true;
+    for (int16_t i = (x > 0) ? x - 1 : 0; i <= ((x < last) ? x + 1 : last); ++i) {
+      uniform &= (above[i] == k && below[i] == k);
+    }
+    guess_pixel(f, stats, buf + x, x, ipos, uniform, k);
+  }
+}
+
+static inline uint8_t generate_point(FractalBuffer* f, uint8_t* buf, int stride, int16_t x, int16_t y)
+{
+  uint8_t* buffptr = buf + y * stride + x;
+  if (*buffptr == FRACTAL_UNKNOWN) {
+    generate_pixel_at(f, x, y, buffptr);
+    fractal_core_stats(f)->count_computed++;
+  }
+  return *buffptr;
+}
+
+// Generate the rectangle with inclusive corners (x0, y0) and (x1, y1)
+static void generate_rect_recurse(FractalBuffer* f, uint8_t* buf, int stride, int16_t x0, int16_t y0, int16_t x1, int16_t y1)
+{
+  if (f->done) return;
+
+  // Compute the whole border even once it is known not to be uniform,
+  // as it is shared with the sub-rectangles.
+  const uint8_t k = generate_point(f, buf, stride, x0, y0);
+  bool uniform = true;
+  for (int16_t x = x0; x <= x1; ++x) {
+    uniform &= (generate_point(f, buf, stride, x, y0) == k);
+    uniform &= (generate_point(f, buf, stride, x, y1) == k);
+  }
+  for (int16_t y = y0 + 1; y < y1; ++y) {
+    uniform &= (generate_point(f, buf, stride, x0, y) == k);
+    uniform &= (generate_point(f, buf, stride, x1, y) == k);
+  }
+
+  if (x1 - x0 < 2 || y1 - y0 < 2) return;
+
+  if (uniform) {
+    for (int16_t y = y0 + 1; y < y1; ++y) {
+      uint8_t* buffptr = buf + y * stride;
+      for (int16_t x = x0 + 1; x < x1; ++x) {
+        if (buffptr[x] == FRACTAL_UNKNOWN) copy_pixel(f, &buffptr[x], k);
+      }
+    }
+  }
+  else if ((x1 - x0 - 1) * (y1 - y0 - 1) <= MIN_SUBDIVIDE_AREA) {
+    for (int16_t y = y0 + 1; y < y1; ++y) {
+      for (int16_t x = x0 + 1; x < x1; ++x) {
+        generate_point(f, buf, stride, x, y);
+      }
+    }
+  }
+  else if (x1 - x0 >= y1 - y0) {
+    int16_t xm = (x0 + x1) >> 1;
+    generate_rect_recurse(f, buf, stride, x0, y0, xm, y1);
+    generate_rect_recurse(f, buf, stride, xm, y0, x1, y1);
+  }
+  else {
+    int16_t ym = (y0 + y1) >> 1;
+    generate_rect_recurse(f, buf, stride, x0, y0, x1, ym);
+    generate_rect_recurse(f, buf, stride, x0, ym, x1, y1);
+  }
+}
+
+void generate_rect(FractalBuffer* f, uint8_t* buf, int stride, int16_t x, int16_t y, int16_t w, int16_t h)
+{
+  reset_cycle_window();
+  generate_rect_recurse(f, buf, stride, x, y, x + w - 1, y + h - 1);
+}
+
+uint32_t fractal_detail_score(const uint8_t* buf, int stride, int rows, int16_t x, int16_t y, int16_t size)
+{
+  uint32_t score = 0;
+  for (int16_t i = y; i < y + size; ++i) {
+    const uint8_t* row = buf + i * stride + x;
+    const uint8_t* next = (i + 1 < rows) ? row + stride : row;
+    for (int16_t j = 0; j < size; ++j) {
+      if (j + 1 < size && row[j] != row[j + 1]) ++score;
+      if (row[j] != next[j]) ++score;
+    }
   }
+  return score;
 }
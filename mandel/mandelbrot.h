@@ -1,3 +1,5 @@
+#pragma once
+
 // Init pico resources used for generation
 void mandel_init();
 
@@ -5,6 +7,54 @@ void mandel_init();
 // Range [-32,32) with precision 2^-26
 typedef int32_t fixed_pt_t;
 
+// Statistics gathered while generating
+typedef struct {
+  uint32_t count_inside;
+  uint32_t count_computed;
+  uint32_t count_iterations;
+  uint32_t count_guessed;  // Pixels copied from their neighbours by solid guessing
+  uint16_t min_iter;
+
+  // Number of escaped pixels with each escape count less iter_offset, clamped to
+  // 1 to 254, which is the value stored unless smooth_map or distance_estimate is
+  // used.  Pixels filled in by solid guessing or generate_rect are counted with the
+  // pixel they were copied from, so with count_inside this counts every pixel set,
+  // which tune_iterations relies on.  Pixels already known in the buffer are not.
+  uint32_t histogram[256];
+
+  // The histogram entry each value was last stored with on this core in this
+  // generation, for counting copies of it.  0 for values not stored yet, which are
+  // counted as themselves, as are copies of values only the other core stored.
+  uint8_t value_keys[256];
+} FractalStats;
+
+// Ways of finding points inside the set before reaching max_iter
+enum {
+  CYCLE_CHECK_NONE,
+  CYCLE_CHECK_FIXED,  // Look for cycles of up to MAX_CYCLE_LEN, every MAX_CYCLE_LEN iterations
+  CYCLE_CHECK_BRENT,  // Compare against a saved point, saving again after windows that double in length
+};
+
+// Number types the set can be iterated with
+enum {
+  PRECISION_AUTO,     // The cheapest that is precise enough for the pixel spacing
+  PRECISION_FIXED32,  // fixed_pt_t
+  PRECISION_FIXED64,  // 64-bit fixed point with 6 bits to the left of the point
+  PRECISION_FLOAT,    // Float and double are only available on the host
+  PRECISION_DOUBLE,
+};
+
+// Smallest pixel spacing each fixed point type is used for.  The rounding error of
+// fixed_pt_t grows with the iterations, so its limit scales with max_iter.  In
+// mandel_accuracy around -0.745-0.105i, at 2^-19 * max_iter 32-bit differs from
+// double on 0.6% of pixels at 500 iterations (spacing 2^-10) and 0.2% at 55.  At 500
+// iterations it differs on 2.7% at 2^-12, 5.8% at 2^-14 and 17% at 2^-16, and on
+// 35827 of 172800 pixels for -0.75 to -0.74 by -0.11 to -0.10, so a fixed limit of
+// 2^-18 is far too small.  The 64-bit type is limited instead by the view being
+// given as doubles.
+#define FIXED32_MIN_INC(max_iter) ((max_iter) * (1. / (1 << 19)))
+#define FIXED64_MIN_INC (1. / (1ll << 48))
+
 typedef struct {
   // Configuration
   int16_t rows;
@@ -12,17 +62,58 @@ typedef struct {
 
   uint16_t max_iter;
   uint16_t iter_offset;
-  float minx, miny, maxx, maxy;
-  bool use_cycle_check;
+  double minx, miny, maxx, maxy;
+  uint8_t cycle_check;
+  uint8_t precision;
+
+  // When set, escaped pixels are stored as a position along a colour gradient
+  // instead of the iteration count: the fraction of an iteration at escape is used
+  // to interpolate from smooth_map[k] to smooth_map[k + 1], which are in 1/256ths
+  // of a value.  It must be non-decreasing and stay within 1 and 254.
+  const uint16_t* smooth_map;
+  bool use_bulb_check;  // Skip iterating points in the main cardioid and period 2 bulb
+
+  // When set, escaped pixels are stored as the estimated distance to the set
+  // instead of the iteration count, see DISTANCE_ONE_PIXEL, which takes precedence
+  // over smooth_map.  Not used by perturbation.
+  bool distance_estimate;
+
+  // When set, generate the Julia set for c = julia_cx + julia_cy i, where each pixel
+  // is the starting z, instead of the Mandelbrot set.  Not used by perturbation.
+  bool julia;
+  double julia_cx, julia_cy;
 
   // State
-  volatile bool done;
-  volatile uint16_t min_iter;
+  volatile bool done;  // Set to abandon generating, this is checked between pixels
   fixed_pt_t iminx, iminy, imaxx, imaxy;
   fixed_pt_t incx, incy;
-  volatile uint32_t count_inside;
+  int64_t iminx64, iminy64;
+  int64_t incx64, incy64;
+  fixed_pt_t icx, icy;
+  int64_t icx64, icy64;
+  double incxd, incyd;
+  uint8_t precision_used;
+  float log2_inc;  // log2 of the pixel spacing
+
+  // Statistics are kept separately for each core while generating,
+  // and combined into stats by fractal_merge_stats.
+  FractalStats core_stats[NUM_CORES];
+  FractalStats stats;
+
+  // Perturbation reference, when set pixels are generated relative to it
+  // instead of using the fixed point view above.
+  struct PerturbRef* perturb;
 } FractalBuffer;
 
+// Value in a buffer for a pixel that hasn't been computed yet
+#define FRACTAL_UNKNOWN 0xff
+
+// With distance_estimate, a pixel a distance d from the set is stored as
+// DISTANCE_ONE_PIXEL + DISTANCE_STEPS_PER_OCTAVE * log2(d / pixel spacing),
+// clamped to 1 to 254.
+#define DISTANCE_ONE_PIXEL 64
+#define DISTANCE_STEPS_PER_OCTAVE 16
+
 // Make a fixed_pt_t from an int or float.
 fixed_pt_t make_fixed(int32_t x);
 fixed_pt_t make_fixedf(float x);
@@ -30,5 +121,38 @@ fixed_pt_t make_fixedf(float x);
 // Generate a section of the fractal into buff
 // Result written to buff is 0 for inside Mandelbrot set
 // Otherwise iteration of escape minus min_iter (clamped to 1)
+// init_fractal sets up the state for the view, choosing the precision if it is PRECISION_AUTO.
 void init_fractal(FractalBuffer* fractal);
+void fractal_merge_stats(FractalBuffer* fractal);
 void generate_one_line(FractalBuffer* f, uint8_t* buf, uint16_t row);
+
+// As generate_one_line, but only computes pixels that are FRACTAL_UNKNOWN in buf,
+// and only every step-th pixel.
+void generate_missing_in_line(FractalBuffer* f, uint8_t* buf, uint16_t row, uint16_t step);
+
+// Generate the point at column x4 / 4, row y4 / 4 into buffptr, for sampling
+// between pixels.  Statistics are updated as for any other pixel.
+void generate_subpixel(FractalBuffer* f, int16_t x4, int16_t y4, uint8_t* buffptr);
+
+// Solid guessing, in two steps.  guess_missing_in_line computes every other pixel
+// of the row, starting from the first, then fills in each pixel between two equal
+// neighbours with their value, computing only the rest.  Once the rows above and
+// below are complete, guess_line_between does the same for the row between them,
+// filling in pixels where the three pixels above and below are all equal.  below
+// may be NULL for the last row, which is then computed in full.
+// As with generate_missing_in_line, only FRACTAL_UNKNOWN pixels are changed.
+void guess_missing_in_line(FractalBuffer* f, uint8_t* buf, uint16_t row);
+void guess_line_between(FractalBuffer* f, uint8_t* buf, const uint8_t* above, const uint8_t* below, uint16_t row);
+
+// Generate the rectangle of w by h pixels at (x, y) into buf, which holds the
+// whole fractal with stride bytes per row.
+// The border of the rectangle is computed first, and if it is all the same value
+// the interior is filled with it, otherwise the rectangle is subdivided.
+// Pixels that aren't FRACTAL_UNKNOWN are assumed to be correct already.
+void generate_rect(FractalBuffer* f, uint8_t* buf, int stride, int16_t x, int16_t y, int16_t w, int16_t h);
+
+// Number of pairs of neighbouring pixels that differ in the size by size square at
+// (x, y) in buf, which has rows rows of stride bytes.  The bottom row of the square
+// is also compared with the row below it, if there is one.  This is highest along
+// the boundary of the set and zero where there is nothing to see.
+uint32_t fractal_detail_score(const uint8_t* buf, int stride, int rows, int16_t x, int16_t y, int16_t size);
@@ -0,0 +1,211 @@
+// Generators for the number types other than 32-bit fixed point, which has its
+// own versions counting iterations with the interpolator.
+//
+// This is included by mandelbrot.c once for each type, with these defined:
+//   KERNEL(name)        Name of the function for this type
+//   real_t              The number type
+//   REAL_SQUARE(a)      a * a
+//   REAL_MUL2(a, b)     a * b * 2
+//   REAL_ESCAPE         4 as a real_t
+//   REAL_TO_FIXED(a)    a as a fixed_pt_t, or a large value if it is out of range
+//   REAL_X(f, x)        Real part of column x of the fractal
+//   REAL_Y(f, y)        Imaginary part of row y of the fractal
+//   REAL_X4(f, x4)      Real part of column x4 / 4, for points between pixels
+//   REAL_Y4(f, y4)      Imaginary part of row y4 / 4
+//   REAL_CX(f)          Real part of c for a Julia set
+//   REAL_CY(f)          Imaginary part of c for a Julia set
+//   REAL_TOLERANCE(f)   Tolerance for the cycle check
+//   REAL_NEAR(a, b, t)  Whether a is within t of b
+//   REAL_ONE            1 as a real_t
+//   REAL_DERIVATIVE_LIMIT  Derivatives are halved to stay below this
+//   REAL_HALF(a)        a / 2
+//   REAL_TO_FLOAT(a)    a as a float
+// and they are undefined again at the end.
+//
+// The cardioid and bulb check isn't used, as these types are only needed when
+// zoomed in too far for it to help.  Both cycle checks compare against the
+// point with REAL_TOLERANCE, which scales with the pixel spacing.
+
+static void KERNEL(generate_one)(FractalBuffer* f, real_t x0, real_t y0, real_t cx, real_t cy, uint8_t* buffptr)
+{
+  real_t x = x0;
+  real_t y = y0;
+  real_t mag = 0;
+
+  uint32_t k = 1;
+  for (; k < f->max_iter; ++k) {
+    real_t x_square = REAL_SQUARE(x);
+    real_t y_square = REAL_SQUARE(y);
+    mag = x_square + y_square;
+    if (mag > REAL_ESCAPE) break;
+
+    real_t nextx = x_square - y_square + cx;
+    y = REAL_MUL2(x, y) + cy;
+    x = nextx;
+  }
+  if (k == f->max_iter) set_inside(f, buffptr, k);
+  else set_escaped(f, buffptr, k, REAL_TO_FIXED(mag));
+}
+
+// Cycle check for cycles of up to MAX_CYCLE_LEN, as generate_one_cycle_check in mandelbrot.c
+static void KERNEL(generate_one_cycle_check)(FractalBuffer* f, real_t x0, real_t y0, real_t cx, real_t cy, uint8_t* buffptr)
+{
+  const real_t tolerance = REAL_TOLERANCE(f);
+  real_t x = x0;
+  real_t y = y0;
+  real_t mag = 0;
+  real_t oldx = 0, oldy = 0;
+
+  uint32_t k = 1;
+  while (true) {
+    real_t x_square = REAL_SQUARE(x);
+    real_t y_square = REAL_SQUARE(y);
+    mag = x_square + y_square;
+    if (mag > REAL_ESCAPE) break;
+
+    if (++k == f->max_iter) {
+      set_inside(f, buffptr, k);
+      return;
+    }
+    if (k >= MIN_CYCLE_CHECK_ITER) {
+      if ((k & (MAX_CYCLE_LEN - 1)) == 0) {
+        oldx = x;
+        oldy = y;
+      }
+      else if (REAL_NEAR(x, oldx, tolerance) && REAL_NEAR(y, oldy, tolerance)) {
+        // Found a cycle
+        set_inside(f, buffptr, k);
+        return;
+      }
+    }
+
+    real_t nextx = x_square - y_square + cx;
+    y = REAL_MUL2(x, y) + cy;
+    x = nextx;
+  }
+
+  set_escaped(f, buffptr, k, REAL_TO_FIXED(mag));
+}
+
+static void KERNEL(generate_one_brent)(FractalBuffer* f, real_t x0, real_t y0, real_t cx, real_t cy, uint8_t* buffptr)
+{
+  const real_t tolerance = REAL_TOLERANCE(f);
+  real_t x = x0;
+  real_t y = y0;
+  real_t mag = 0;
+  real_t oldx = 0, oldy = 0;
+  uint16_t* window_hint = &cycle_window_hint[get_core_num()];
+  uint32_t window = *window_hint;
+  uint32_t saved_k = 0;
+  uint32_t next_save = MIN_CYCLE_CHECK_ITER;
+
+  uint32_t k = 1;
+  while (true) {
+    real_t x_square = REAL_SQUARE(x);
+    real_t y_square = REAL_SQUARE(y);
+    mag = x_square + y_square;
+    if (mag > REAL_ESCAPE) break;
+
+    if (++k == f->max_iter) {
+      set_inside(f, buffptr, k);
+      return;
+    }
+    if (saved_k && REAL_NEAR(x, oldx, tolerance) && REAL_NEAR(y, oldy, tolerance)) {
+      // Found a cycle
+      uint32_t period = 1;
+      while (period < k - saved_k) period <<= 1;
+      *window_hint = period;
+      set_inside(f, buffptr, k);
+      return;
+    }
+    if (k == next_save) {
+      oldx = x;
+      oldy = y;
+      saved_k = k;
+      next_save = k + window;
+      if (window < MAX_CYCLE_WINDOW) window <<= 1;
+    }
+
+    real_t nextx = x_square - y_square + cx;
+    y = REAL_MUL2(x, y) + cy;
+    x = nextx;
+  }
+
+  set_escaped(f, buffptr, k, REAL_TO_FIXED(mag));
+}
+
+// Distance estimation, as generate_one_distance in mandelbrot.c
+static void KERNEL(generate_one_distance)(FractalBuffer* f, real_t x0, real_t y0, real_t cx, real_t cy, uint8_t* buffptr)
+{
+  real_t x = x0;
+  real_t y = y0;
+  real_t mag = 0;
+  real_t dx = REAL_ONE;
+  real_t dy = 0;
+  real_t one = f->julia ? 0 : REAL_ONE;
+  int32_t dz_exp = 0;
+
+  uint32_t k = 1;
+  for (; k < f->max_iter; ++k) {
+    real_t x_square = REAL_SQUARE(x);
+    real_t y_square = REAL_SQUARE(y);
+    mag = x_square + y_square;
+    if (mag > REAL_ESCAPE) break;
+
+    real_t nextdx = REAL_MUL2(x, dx) - REAL_MUL2(y, dy) + one;
+    dy = REAL_MUL2(x, dy) + REAL_MUL2(y, dx);
+    dx = nextdx;
+    while (dx >= REAL_DERIVATIVE_LIMIT || dx <= -REAL_DERIVATIVE_LIMIT ||
+           dy >= REAL_DERIVATIVE_LIMIT || dy <= -REAL_DERIVATIVE_LIMIT) {
+      dx = REAL_HALF(dx);
+      dy = REAL_HALF(dy);
+      one = REAL_HALF(one);
+      ++dz_exp;
+    }
+
+    real_t nextx = x_square - y_square + cx;
+    y = REAL_MUL2(x, y) + cy;
+    x = nextx;
+  }
+  if (k == f->max_iter) set_inside(f, buffptr, k);
+  else set_distance(f, buffptr, k, distance_log2(REAL_TO_FLOAT(mag), REAL_TO_FLOAT(REAL_SQUARE(dx) + REAL_SQUARE(dy)), dz_exp));
+}
+
+static void KERNEL(generate_point)(FractalBuffer* f, real_t x0, real_t y0, uint8_t* buffptr)
+{
+  const real_t cx = f->julia ? REAL_CX(f) : x0;
+  const real_t cy = f->julia ? REAL_CY(f) : y0;
+  if (f->distance_estimate) KERNEL(generate_one_distance)(f, x0, y0, cx, cy, buffptr);
+  else if (f->cycle_check == CYCLE_CHECK_FIXED) KERNEL(generate_one_cycle_check)(f, x0, y0, cx, cy, buffptr);
+  else if (f->cycle_check == CYCLE_CHECK_BRENT) KERNEL(generate_one_brent)(f, x0, y0, cx, cy, buffptr);
+  else KERNEL(generate_one)(f, x0, y0, cx, cy, buffptr);
+}
+
+static void KERNEL(generate_pixel)(FractalBuffer* f, int16_t x, int16_t y, uint8_t* buffptr)
+{
+  KERNEL(generate_point)(f, REAL_X(f, x), REAL_Y(f, y), buffptr);
+}
+
+static void KERNEL(generate_subpixel)(FractalBuffer* f, int16_t x4, int16_t y4, uint8_t* buffptr)
+{
+  KERNEL(generate_point)(f, REAL_X4(f, x4), REAL_Y4(f, y4), buffptr);
+}
+
+#undef KERNEL
+#undef real_t
+#undef REAL_SQUARE
+#undef REAL_MUL2
+#undef REAL_ESCAPE
+#undef REAL_TO_FIXED
+#undef REAL_X
+#undef REAL_Y
+#undef REAL_X4
+#undef REAL_Y4
+#undef REAL_CX
+#undef REAL_CY
+#undef REAL_TOLERANCE
+#undef REAL_NEAR
+#undef REAL_ONE
+#undef REAL_DERIVATIVE_LIMIT
+#undef REAL_HALF
+#undef REAL_TO_FLOAT
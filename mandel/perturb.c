@@ -0,0 +1,314 @@
+// Perturbation rendering for deep zooms
+
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include "pico/stdlib.h"
+
+#include "perturb.h"
+#include "fixed_pt.h"
+
+static void mp_neg(mp_fixed_t* r, const mp_fixed_t* a)
+{
+  uint32_t carry = 1;
+  for (int i = 0; i < MP_WORDS; ++i) {
+    uint32_t v = ~a->w[i] + carry;
+    carry = (carry && v == 0);
+    r->w[i] = v;
+  }
+}
+
+void mp_from_double(mp_fixed_t* r, double x)
+{
+  memset(r, 0, sizeof(mp_fixed_t));
+  bool neg = x < 0;
+  if (neg) x = -x;
+
+  // x = mant * 2^(e - 53), place mant at bit e - 53 + 122
+  int e;
+  uint64_t mant = (uint64_t)ldexp(frexp(x, &e), 53);
+  int shift = e - 53 + (32 * MP_WORDS - 6);
+  if (shift < 0) {
+    mant = (shift > -64) ? (mant >> -shift) : 0;
+    shift = 0;
+  }
+
+  const int word = shift >> 5;
+  const int bit = shift & 31;
+  const uint64_t lo = mant << bit;
+  const uint32_t hi = bit ? (uint32_t)(mant >> (64 - bit)) : 0;
+  if (word < MP_WORDS) r->w[word] = (uint32_t)lo;
+  if (word + 1 < MP_WORDS) r->w[word + 1] = (uint32_t)(lo >> 32);
+  if (word + 2 < MP_WORDS) r->w[word + 2] = hi;
+
+  if (neg) mp_neg(r, r);
+}
+
+void mp_add(mp_fixed_t* r, const mp_fixed_t* a, const mp_fixed_t* b)
+{
+  uint32_t carry = 0;
+  for (int i = 0; i < MP_WORDS; ++i) {
+    uint64_t t = (uint64_t)a->w[i] + b->w[i] + carry;
+    r->w[i] = (uint32_t)t;
+    carry = t >> 32;
+  }
+}
+
+void mp_sub(mp_fixed_t* r, const mp_fixed_t* a, const mp_fixed_t* b)
+{
+  mp_fixed_t nb;
+  mp_neg(&nb, b);
+  mp_add(r, a, &nb);
+}
+
+void mp_mul(mp_fixed_t* r, const mp_fixed_t* a, const mp_fixed_t* b)
+{
+  mp_fixed_t ua = *a, ub = *b;
+  bool neg = false;
+  if ((int32_t)ua.w[MP_WORDS - 1] < 0) {
+    mp_neg(&ua, &ua);
+    neg = !neg;
+  }
+  if ((int32_t)ub.w[MP_WORDS - 1] < 0) {
+    mp_neg(&ub, &ub);
+    neg = !neg;
+  }
+
+  uint32_t prod[2 * MP_WORDS];
+  memset(prod, 0, sizeof(prod));
+  for (int i = 0; i < MP_WORDS; ++i) {
+    uint64_t carry = 0;
+    for (int j = 0; j < MP_WORDS; ++j) {
+      uint64_t t = (uint64_t)ua.w[i] * ub.w[j] + prod[i + j] + carry;
+      prod[i + j] = (uint32_t)t;
+      carry = t >> 32;
+    }
+    prod[i + MP_WORDS] = (uint32_t)carry;
+  }
+
+  // Shift back down by the 32 * MP_WORDS - 6 fractional bits
+  for (int i = 0; i < MP_WORDS; ++i) {
+    r->w[i] = (prod[i + MP_WORDS - 1] >> 26) | (prod[i + MP_WORDS] << 6);
+  }
+
+  if (neg) mp_neg(r, r);
+}
+
+// |z|^2, or INT32_MAX if a component is too large for the squares to be in range
+static inline fixed_pt_t fixed_magnitude(fixed_pt_t x, fixed_pt_t y)
+{
+  if (x > (2 << 26) || x < -(2 << 26) || y > (2 << 26) || y < -(2 << 26)) return INT32_MAX;
+  return square(x) + square(y);
+}
+
+static inline bool fixed_escaped(fixed_pt_t x, fixed_pt_t y)
+{
+  return fixed_magnitude(x, y) > ESCAPE_SQUARE;
+}
+
+void perturb_init(FractalBuffer* f, PerturbRef* ref, const mp_fixed_t* cx, const mp_fixed_t* cy, double inc_x, double inc_y)
+{
+  ref->cx = *cx;
+  ref->cy = *cy;
+
+  // Scale so the larger increment is in [2^24, 2^25)
+  int e;
+  frexp(inc_x > inc_y ? inc_x : inc_y, &e);
+  ref->inc_exp = e - 25;
+  ref->inc_x = (int32_t)ldexp(inc_x, -ref->inc_exp);
+  ref->inc_y = (int32_t)ldexp(inc_y, -ref->inc_exp);
+
+  mp_fixed_t x, y, x2, y2, xy;
+  memset(&x, 0, sizeof(x));
+  memset(&y, 0, sizeof(y));
+  const uint16_t max_iter = (f->max_iter < PERTURB_MAX_ITER) ? f->max_iter : PERTURB_MAX_ITER;
+  uint16_t n = 0;
+  while (n < max_iter) {
+    const fixed_pt_t fx = x.w[MP_WORDS - 1];
+    const fixed_pt_t fy = y.w[MP_WORDS - 1];
+    if (fixed_escaped(fx, fy)) break;
+    ref->orbit_x[n] = fx;
+    ref->orbit_y[n] = fy;
+    ++n;
+
+    mp_mul(&x2, &x, &x);
+    mp_mul(&y2, &y, &y);
+    mp_mul(&xy, &x, &y);
+    mp_sub(&x, &x2, &y2);
+    mp_add(&x, &x, cx);
+    mp_add(&y, &xy, &xy);
+    mp_add(&y, &y, cy);
+  }
+  ref->orbit_len = n;
+
+  f->perturb = ref;
+}
+
+// Deltas are stored as x * 2^e, y * 2^e, normalised so that the
+// larger of |x| and |y| is in [2^24, 2^25), which leaves enough headroom
+// that multiplying by 2Z + dz can't overflow.
+#define DELTA_BITS 25
+
+static inline void normalise(int32_t* x, int32_t* y, int* e)
+{
+  uint32_t v = (uint32_t)abs(*x) | (uint32_t)abs(*y);
+  if (v == 0) return;
+  int shift = (32 - DELTA_BITS) - __builtin_clz(v);
+  if (shift > 0) {
+    *x >>= shift;
+    *y >>= shift;
+  }
+  else {
+    *x <<= -shift;
+    *y <<= -shift;
+  }
+  *e += shift;
+}
+
+static inline void normalise64(int64_t x, int64_t y, int32_t* rx, int32_t* ry, int* e)
+{
+  uint64_t v = (uint64_t)llabs(x) | (uint64_t)llabs(y);
+  uint32_t hi = v >> 32;
+  int bits = hi ? 64 - __builtin_clz(hi) : (v ? 32 - __builtin_clz((uint32_t)v) : 0);
+  int shift = bits - DELTA_BITS;
+  if (shift > 0) {
+    x >>= shift;
+    y >>= shift;
+    *e += shift;
+  }
+  *rx = (int32_t)x;
+  *ry = (int32_t)y;
+  if (shift < 0) normalise(rx, ry, e);
+}
+
+// Convert a delta component to fixed point, the exponent must be at most 4 - 26
+static inline fixed_pt_t delta_to_fixed(int32_t x, int e)
+{
+  int shift = e + 26;
+  if (shift >= 0) return x << shift;
+  if (shift <= -31) return 0;
+  return x >> -shift;
+}
+
+// Add b * 2^eb to a * 2^ea
+static inline void add_delta(int32_t* ax, int32_t* ay, int* ea, int32_t bx, int32_t by, int eb)
+{
+  if (eb > *ea) {
+    int d = eb - *ea;
+    if (d > 31) {
+      *ax = bx;
+      *ay = by;
+    }
+    else {
+      *ax = (*ax >> d) + bx;
+      *ay = (*ay >> d) + by;
+    }
+    *ea = eb;
+  }
+  else {
+    int d = *ea - eb;
+    if (d <= 31) {
+      *ax += bx >> d;
+      *ay += by >> d;
+    }
+  }
+}
+
+// Generate the point offset from the reference point by ox, oy in units of
+// 2^-shift pixels.
+static void perturb_generate_offset(FractalBuffer* f, int32_t ox, int32_t oy, int shift, uint8_t* buffptr)
+{
+  const PerturbRef* ref = f->perturb;
+
+  int32_t dcx, dcy;
+  int dce = ref->inc_exp - shift;
+  normalise64((int64_t)ox * ref->inc_x, (int64_t)oy * ref->inc_y, &dcx, &dcy, &dce);
+
+  // Start at the first iteration, which is just c
+  int32_t dx = dcx, dy = dcy;
+  int e = dce;
+  uint16_t m = 1;
+  uint16_t k = 1;
+  fixed_pt_t mag = INT32_MAX;
+
+  if (ref->orbit_len < 2) {
+    // The reference escapes immediately, so this view is nowhere near the set.
+    // There is no Z1 = C to add the delta to, so the pixel's own c = C + dc is
+    // used instead, relative to Z0 = 0 throughout, as after rebasing below.  A
+    // delta too large to convert has escaped already.
+    if (dce <= 2 - DELTA_BITS) {
+      dcx = (fixed_pt_t)ref->cx.w[MP_WORDS - 1] + delta_to_fixed(dcx, dce);
+      dcy = (fixed_pt_t)ref->cy.w[MP_WORDS - 1] + delta_to_fixed(dcy, dce);
+      dce = -26;
+      normalise(&dcx, &dcy, &dce);
+      dx = dcx;
+      dy = dcy;
+      e = dce;
+    }
+    m = 0;
+  }
+
+  while (true) {
+    // |Z| <= 2 so once the delta is at least 4 the pixel has escaped,
+    // this also bounds the delta so it can be converted to fixed point.
+    if (e > 2 - DELTA_BITS) break;
+
+    const fixed_pt_t dzx = delta_to_fixed(dx, e);
+    const fixed_pt_t dzy = delta_to_fixed(dy, e);
+    const fixed_pt_t zx = ref->orbit_x[m] + dzx;
+    const fixed_pt_t zy = ref->orbit_y[m] + dzy;
+    mag = fixed_magnitude(zx, zy);
+    if (mag > ESCAPE_SQUARE) break;
+    mag = INT32_MAX;
+
+    if (++k == f->max_iter) {
+      set_inside(f, buffptr, k);
+      return;
+    }
+
+    // Rebase when the reference runs out, or when the pixel is closer to the
+    // start of the orbit than to the reference, which would otherwise lose precision.
+    if (m == ref->orbit_len - 1 ||
+        ((square(zx) + square(zy)) >> 2) < square(dzx >> 1) + square(dzy >> 1)) {
+      dx = zx;
+      dy = zy;
+      e = -26;
+      normalise(&dx, &dy, &e);
+      m = 0;
+    }
+
+    if (m == 0) {
+      // Z is 0, so the new delta is dz^2 + dc, done at full precision.
+      int64_t sx = (int64_t)dx * dx - (int64_t)dy * dy;
+      int64_t sy = 2 * (int64_t)dx * dy;
+      e *= 2;
+      normalise64(sx, sy, &dx, &dy, &e);
+    }
+    else {
+      // (2Z + dz) * dz
+      const fixed_pt_t ax = 2 * ref->orbit_x[m] + dzx;
+      const fixed_pt_t ay = 2 * ref->orbit_y[m] + dzy;
+      const int32_t nx = mul(ax, dx) - mul(ay, dy);
+      dy = mul(ax, dy) + mul(ay, dx);
+      dx = nx;
+    }
+
+    if (dx == 0 && dy == 0) e = dce;
+    add_delta(&dx, &dy, &e, dcx, dcy, dce);
+    normalise(&dx, &dy, &e);
+    if (++m == ref->orbit_len) m = 0;
+  }
+
+  set_escaped(f, buffptr, k, mag);
+}
+
+void perturb_generate_one(FractalBuffer* f, int16_t px, int16_t py, uint8_t* buffptr)
+{
+  // The reference is at the centre of the full frame, so the offset is in half pixels
+  perturb_generate_offset(f, 2 * px - f->cols + 1, 2 * py - 2 * f->rows + 1, 1, buffptr);
+}
+
+void perturb_generate_subpixel(FractalBuffer* f, int16_t x4, int16_t y4, uint8_t* buffptr)
+{
+  perturb_generate_offset(f, x4 - 2 * f->cols + 2, y4 - 4 * f->rows + 2, 2, buffptr);
+}
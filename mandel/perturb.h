@@ -0,0 +1,49 @@
+// Perturbation rendering for deep zooms
+//
+// One reference orbit is computed per frame in multi-word fixed point, and each
+// pixel is then iterated as a small delta from the reference, which only needs
+// a few bits of precision, stored as a 32-bit mantissa and a binary exponent.
+
+#pragma once
+
+#include "mandelbrot.h"
+
+// Multi-word fixed point, two's complement with the least significant word first.
+// Like fixed_pt_t there are 6 bits to the left of the point, so the most
+// significant word is the value as a fixed_pt_t.
+#define MP_WORDS 4
+typedef struct {
+  uint32_t w[MP_WORDS];
+} mp_fixed_t;
+
+void mp_from_double(mp_fixed_t* r, double x);
+void mp_add(mp_fixed_t* r, const mp_fixed_t* a, const mp_fixed_t* b);
+void mp_sub(mp_fixed_t* r, const mp_fixed_t* a, const mp_fixed_t* b);
+void mp_mul(mp_fixed_t* r, const mp_fixed_t* a, const mp_fixed_t* b);
+
+// Longest reference orbit, max_iter must not be more than this in perturbation mode
+#define PERTURB_MAX_ITER 1024
+
+typedef struct PerturbRef {
+  // The reference point, which is the centre of the full (mirrored) frame
+  mp_fixed_t cx, cy;
+
+  // Spacing between pixels is inc * 2^inc_exp
+  int32_t inc_x, inc_y;
+  int16_t inc_exp;
+
+  // Orbit of the reference point, until it escapes or reaches max_iter
+  uint16_t orbit_len;
+  fixed_pt_t orbit_x[PERTURB_MAX_ITER];
+  fixed_pt_t orbit_y[PERTURB_MAX_ITER];
+} PerturbRef;
+
+// Set up the reference for a view centred on (cx, cy) with pixel spacing inc_x by inc_y,
+// and attach it to the fractal.  init_fractal should be called first.
+void perturb_init(FractalBuffer* f, PerturbRef* ref, const mp_fixed_t* cx, const mp_fixed_t* cy, double inc_x, double inc_y);
+
+// Generate the pixel at column x, row y of the fractal into buffptr
+void perturb_generate_one(FractalBuffer* f, int16_t x, int16_t y, uint8_t* buffptr);
+
+// As perturb_generate_one, for the point at column x4 / 4, row y4 / 4
+void perturb_generate_subpixel(FractalBuffer* f, int16_t x4, int16_t y4, uint8_t* buffptr);